@@ -0,0 +1,348 @@
+/*
+  Copyright (C) 2020 Embed Creativity LLC
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "EEPROMBackend.h"
+
+// OS-dependent adapter declarations
+#if defined(__linux__)
+    #include <fcntl.h>
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
+    #include <driverlib/eeprom.h>
+#else // Assert failure
+    #error Environment must either be defined as __linux__ or TIVAWARE. Add additional support for new environments as needed.
+#endif
+
+#include <algorithm>    // std::min
+#include <cstring>
+#include <new>
+
+/*****************************************************************************************************/
+/* RAM                                                                                               */
+/*****************************************************************************************************/
+
+EEPROMRamBackend::EEPROMRamBackend(uint32_t size) :
+    wordAlignedMemory(NULL),
+    memorySize(size)
+{
+}
+
+EEPROMRamBackend::~EEPROMRamBackend()
+{
+    delete[] wordAlignedMemory;
+}
+
+bool EEPROMRamBackend::init()
+{
+    if ( NULL == wordAlignedMemory )
+    {
+        // round up so a size that is not whole words still gets all of its bytes
+        wordAlignedMemory = new (std::nothrow) uint32_t[((memorySize + 3)>>2)];
+        if ( NULL == wordAlignedMemory )
+        {
+            return false;
+        }
+        // a fresh part comes up erased
+        std::memset(wordAlignedMemory, 0xFF, memorySize);
+    }
+    return true;
+}
+
+uint32_t EEPROMRamBackend::size()
+{
+    return memorySize;
+}
+
+bool EEPROMRamBackend::read(uint8_t* buf, uint32_t address, uint32_t len)
+{
+    std::memcpy(buf, (uint8_t*)wordAlignedMemory + address, len);
+    return true;
+}
+
+bool EEPROMRamBackend::program(const uint8_t* buf, uint32_t address, uint32_t len)
+{
+    std::memcpy((uint8_t*)wordAlignedMemory + address, buf, len);
+    return true;
+}
+
+bool EEPROMRamBackend::massErase()
+{
+    std::memset(wordAlignedMemory, 0xFF, memorySize);
+    return true;
+}
+
+#if defined(__linux__)
+/*****************************************************************************************************/
+/* File                                                                                              */
+/*****************************************************************************************************/
+
+// Resize the file behind fd to size bytes and fill it with 0xFF
+static bool eraseFile(int fd, uint32_t size)
+{
+    uint8_t filler[256];
+
+    std::memset(filler, 0xFF, sizeof(filler));
+    if ( 0 != ftruncate(fd, size) )
+    {
+        return false;
+    }
+    for ( uint32_t i = 0; i < size; i += sizeof(filler) )
+    {
+        uint32_t chunk = std::min(static_cast<uint32_t>(sizeof(filler)), size - i);
+        if ( static_cast<ssize_t>(chunk) != pwrite(fd, filler, chunk, i) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Open (creating if needed) the file at path and make sure it is exactly size bytes.
+//   A file of any other size is treated like a blank part and erased.
+static int openImage(const char* path, uint32_t size)
+{
+    struct stat imageStat;
+    int fd;
+
+    fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if ( 0 > fd )
+    {
+        return -1;
+    }
+    if ( (0 != fstat(fd, &imageStat)) ||
+         ((static_cast<uint32_t>(imageStat.st_size) != size) && !eraseFile(fd, size)) )
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+EEPROMFileBackend::EEPROMFileBackend(const char* path, uint32_t size) :
+    path(path),
+    fileSize(size),
+    fd(-1)
+{
+}
+
+EEPROMFileBackend::~EEPROMFileBackend()
+{
+    if ( 0 <= fd )
+    {
+        ::close(fd);
+    }
+}
+
+bool EEPROMFileBackend::init()
+{
+    if ( 0 > fd )
+    {
+        fd = openImage(path, fileSize);
+    }
+    return (0 <= fd);
+}
+
+uint32_t EEPROMFileBackend::size()
+{
+    return fileSize;
+}
+
+bool EEPROMFileBackend::read(uint8_t* buf, uint32_t address, uint32_t len)
+{
+    return (static_cast<ssize_t>(len) == pread(fd, buf, len, address));
+}
+
+bool EEPROMFileBackend::program(const uint8_t* buf, uint32_t address, uint32_t len)
+{
+    return (static_cast<ssize_t>(len) == pwrite(fd, buf, len, address));
+}
+
+bool EEPROMFileBackend::massErase()
+{
+    return eraseFile(fd, fileSize);
+}
+
+/*****************************************************************************************************/
+/* mmap                                                                                              */
+/*****************************************************************************************************/
+
+EEPROMMmapBackend::EEPROMMmapBackend(const char* path, uint32_t size) :
+    path(path),
+    fileSize(size),
+    fd(-1),
+    map(NULL)
+{
+}
+
+EEPROMMmapBackend::~EEPROMMmapBackend()
+{
+    if ( NULL != map )
+    {
+        msync(map, fileSize, MS_SYNC);
+        munmap(map, fileSize);
+    }
+    if ( 0 <= fd )
+    {
+        ::close(fd);
+    }
+}
+
+bool EEPROMMmapBackend::init()
+{
+    void* addr;
+
+    if ( NULL != map )
+    {
+        return true;
+    }
+    fd = openImage(path, fileSize);
+    if ( 0 > fd )
+    {
+        return false;
+    }
+    addr = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if ( MAP_FAILED == addr )
+    {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    map = (uint8_t*)addr;
+    return true;
+}
+
+uint32_t EEPROMMmapBackend::size()
+{
+    return fileSize;
+}
+
+bool EEPROMMmapBackend::read(uint8_t* buf, uint32_t address, uint32_t len)
+{
+    std::memcpy(buf, map + address, len);
+    return true;
+}
+
+bool EEPROMMmapBackend::program(const uint8_t* buf, uint32_t address, uint32_t len)
+{
+    uintptr_t pageMask = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1;
+    uint8_t* pageStart;
+
+    std::memcpy(map + address, buf, len);
+
+    // msync needs a page aligned start address
+    pageStart = (uint8_t*)((uintptr_t)(map + address) & ~pageMask);
+    return (0 == msync(pageStart, (map + address + len) - pageStart, MS_ASYNC));
+}
+
+bool EEPROMMmapBackend::massErase()
+{
+    std::memset(map, 0xFF, fileSize);
+    return (0 == msync(map, fileSize, MS_ASYNC));
+}
+
+/*****************************************************************************************************/
+/* Latency injection                                                                                 */
+/*****************************************************************************************************/
+
+EEPROMLatencyBackend::EEPROMLatencyBackend(EEPROMBackend& target, uint32_t usPerOperation, uint32_t usPerWord) :
+    target(target),
+    usPerOperation(usPerOperation),
+    usPerWord(usPerWord)
+{
+}
+
+bool EEPROMLatencyBackend::init()
+{
+    return target.init();
+}
+
+uint32_t EEPROMLatencyBackend::size()
+{
+    return target.size();
+}
+
+bool EEPROMLatencyBackend::read(uint8_t* buf, uint32_t address, uint32_t len)
+{
+    return target.read(buf, address, len);
+}
+
+bool EEPROMLatencyBackend::program(const uint8_t* buf, uint32_t address, uint32_t len)
+{
+    delay(usPerOperation + (usPerWord * (len >> 2)));
+    return target.program(buf, address, len);
+}
+
+bool EEPROMLatencyBackend::massErase()
+{
+    delay(usPerOperation);
+    return target.massErase();
+}
+
+void EEPROMLatencyBackend::delay(uint32_t us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    while ( 0 != nanosleep(&ts, &ts) )
+    {
+        // interrupted by a signal - sleep for whatever remains
+    }
+}
+
+#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
+/*****************************************************************************************************/
+/* TivaWare                                                                                          */
+/*****************************************************************************************************/
+
+EEPROMTivaBackend::EEPROMTivaBackend()
+{
+}
+
+bool EEPROMTivaBackend::init()
+{
+    return (EEPROM_INIT_OK == EEPROMInit());
+}
+
+uint32_t EEPROMTivaBackend::size()
+{
+    return EEPROMSizeGet();
+}
+
+bool EEPROMTivaBackend::read(uint8_t* buf, uint32_t address, uint32_t len)
+{
+    EEPROMRead((uint32_t*)buf, address, len);
+    return true;
+}
+
+bool EEPROMTivaBackend::program(const uint8_t* buf, uint32_t address, uint32_t len)
+{
+    // API returns 0 on success, otherwise API-specific error code we don't want to get into
+    return (0 == EEPROMProgram((uint32_t*)buf, address, len));
+}
+
+bool EEPROMTivaBackend::massErase()
+{
+    return (0 == EEPROMMassErase());
+}
+#endif
+
+/******************************* EOF *******************************************/
@@ -0,0 +1,157 @@
+/*
+  Copyright (C) 2020 Embed Creativity LLC
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EEPROM_BACKEND_H_
+#define EEPROM_BACKEND_H_
+
+#include <cstdint>
+
+// Defaults for the file-backed faux EEPROM used in the Unix/Linux test environment
+#define UNIX_NONVOLATILE_FILE           "nonvolatile.bin"
+#define UNIX_FILE_SIZE                  2048
+
+// Storage medium underneath the EEPROMFS file system.
+//   EEPROMFS mirrors the whole medium in RAM and only calls into the backend
+//   to load the image, to program modified word-aligned ranges and to erase.
+//   Addresses and lengths handed to a backend are always multiples of 4.
+class EEPROMBackend
+{
+public:
+    virtual ~EEPROMBackend() {};
+
+    // Bring up the storage hardware (or open the backing store)
+    // Returns true if successful, false if there was an error
+    virtual bool init() = 0;
+
+    // Return size of the storage medium (in bytes)
+    virtual uint32_t size() = 0;
+
+    // Read len bytes starting at address into buf
+    // Returns true if successful, false if there was an error
+    virtual bool read(uint8_t* buf, uint32_t address, uint32_t len) = 0;
+
+    // Program len bytes from buf into the medium starting at address
+    // Returns true if successful, false if there was an error
+    virtual bool program(const uint8_t* buf, uint32_t address, uint32_t len) = 0;
+
+    // Set the entire medium to the erased state (all 0xFF)
+    // Returns true if successful, false if there was an error
+    virtual bool massErase() = 0;
+};
+
+// Volatile backend keeping the "EEPROM" in a heap buffer.
+//   Useful for benchmarking the file system without any I/O noise.
+class EEPROMRamBackend : public EEPROMBackend
+{
+public:
+    EEPROMRamBackend(uint32_t size);
+    ~EEPROMRamBackend();
+
+    bool init();
+    uint32_t size();
+    bool read(uint8_t* buf, uint32_t address, uint32_t len);
+    bool program(const uint8_t* buf, uint32_t address, uint32_t len);
+    bool massErase();
+
+private:
+    uint32_t* wordAlignedMemory;
+    uint32_t memorySize;
+};
+
+#if defined(__linux__)
+// Backend storing the "EEPROM" in a regular file.
+//   The descriptor stays open for the lifetime of the object and every
+//   program operation is a single positioned write of the affected range.
+class EEPROMFileBackend : public EEPROMBackend
+{
+public:
+    EEPROMFileBackend(const char* path = UNIX_NONVOLATILE_FILE, uint32_t size = UNIX_FILE_SIZE);
+    ~EEPROMFileBackend();
+
+    bool init();
+    uint32_t size();
+    bool read(uint8_t* buf, uint32_t address, uint32_t len);
+    bool program(const uint8_t* buf, uint32_t address, uint32_t len);
+    bool massErase();
+
+private:
+    const char* path;
+    uint32_t fileSize;
+    int fd;
+};
+
+// Backend mapping the "EEPROM" file into memory.
+//   Program operations are a memcpy into the shared mapping followed by an
+//   asynchronous msync of the touched pages.
+class EEPROMMmapBackend : public EEPROMBackend
+{
+public:
+    EEPROMMmapBackend(const char* path = UNIX_NONVOLATILE_FILE, uint32_t size = UNIX_FILE_SIZE);
+    ~EEPROMMmapBackend();
+
+    bool init();
+    uint32_t size();
+    bool read(uint8_t* buf, uint32_t address, uint32_t len);
+    bool program(const uint8_t* buf, uint32_t address, uint32_t len);
+    bool massErase();
+
+private:
+    const char* path;
+    uint32_t fileSize;
+    int fd;
+    uint8_t* map;
+};
+
+// Decorator that forwards to another backend and adds a fixed delay per
+//   program/erase operation plus a delay per programmed word, mimicking the
+//   timing of a real part during host-side simulation.
+class EEPROMLatencyBackend : public EEPROMBackend
+{
+public:
+    EEPROMLatencyBackend(EEPROMBackend& target, uint32_t usPerOperation, uint32_t usPerWord);
+
+    bool init();
+    uint32_t size();
+    bool read(uint8_t* buf, uint32_t address, uint32_t len);
+    bool program(const uint8_t* buf, uint32_t address, uint32_t len);
+    bool massErase();
+
+private:
+    void delay(uint32_t us);
+
+    EEPROMBackend& target;
+    uint32_t usPerOperation;
+    uint32_t usPerWord;
+};
+
+#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
+// Backend driving the on-chip EEPROM through the TivaWare driverlib API
+class EEPROMTivaBackend : public EEPROMBackend
+{
+public:
+    EEPROMTivaBackend();
+
+    bool init();
+    uint32_t size();
+    bool read(uint8_t* buf, uint32_t address, uint32_t len);
+    bool program(const uint8_t* buf, uint32_t address, uint32_t len);
+    bool massErase();
+};
+#endif
+
+#endif /* EEPROM_BACKEND_H_ */
@@ -0,0 +1,29 @@
+/*
+  Copyright (C) 2020 Embed Creativity LLC
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EEPROM_CRC_H_
+#define EEPROM_CRC_H_
+
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320) of len bytes at buf.
+//   Pass the result of a previous call as crc to checksum data in pieces;
+//   the CRC of zero bytes is zero.
+uint32_t eepromCrc32(const uint8_t* buf, uint32_t len, uint32_t crc = 0);
+
+#endif /* EEPROM_CRC_H_ */
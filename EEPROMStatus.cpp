@@ -21,7 +21,8 @@
 #include <cstring>
 
 EEPROMStatus::EEPROMStatus () :
-    status(EEPROM_ERROR_NOT_INITIALIZED)
+    status(EEPROM_ERROR_NOT_INITIALIZED),
+    errorOffset(0)
 {
     memset(szStatus, 0, EEPROMSTATUS_BUF_LEN); // init array with null
 }
@@ -29,6 +30,13 @@ EEPROMStatus::EEPROMStatus () :
 void EEPROMStatus::setStatus(eepromStatus_t input)
 {
     status = input;
+    errorOffset = 0;
+}
+
+void EEPROMStatus::setStatus(eepromStatus_t input, uint32_t offset)
+{
+    status = input;
+    errorOffset = offset;
 }
 
 EEPROMStatus::eepromStatus_t EEPROMStatus::value()
@@ -36,6 +44,11 @@ EEPROMStatus::eepromStatus_t EEPROMStatus::value()
     return status;
 }
 
+uint32_t EEPROMStatus::offset()
+{
+    return errorOffset;
+}
+
 char* EEPROMStatus::c_str ()
 {
     switch(status)
@@ -82,6 +95,9 @@ char* EEPROMStatus::c_str ()
     case EEPROM_ERROR_INTERNAL:
         snprintf(szStatus, EEPROMSTATUS_BUF_LEN, "INTERNAL ERROR");
         break;
+    case EEPROM_ERROR_CORRUPTED_FILE:
+        snprintf(szStatus, EEPROMSTATUS_BUF_LEN, "CORRUPTED FILE");
+        break;
     default:
         snprintf(szStatus, EEPROMSTATUS_BUF_LEN, "UNKNOWN");
     }
@@ -19,6 +19,8 @@
 #ifndef BOARD_UTILS_EEPROM_EEPROMSTATUS_H_
 #define BOARD_UTILS_EEPROM_EEPROMSTATUS_H_
 
+#include <cstdint>
+
 // size of char array used for printing EEPROM status (sizeof(uint8_t) or less)
 #define EEPROMSTATUS_BUF_LEN            20
 class EEPROMStatus
@@ -51,7 +53,9 @@ public:
         // Used to reflect an API-specific error was returned as a result of last operation
         EEPROM_ERROR_API,
         // Used to reflect an error internal to our implementation
-        EEPROM_ERROR_INTERNAL
+        EEPROM_ERROR_INTERNAL,
+        // File failed its checksum or content check at mount time and was quarantined
+        EEPROM_ERROR_CORRUPTED_FILE
     } eepromStatus_t;
 
     // Constructor
@@ -63,11 +67,17 @@ public:
     void setStatus(eepromStatus_t status);
     eepromStatus_t value();
 
+    // Content errors (EEPROM_ERROR_NON_ASCII, EEPROM_ERROR_UNEXPECTED_NULLS) also record the
+    //   offset of the first offending byte in the buffer that was refused, 0 for other statuses
+    void setStatus(eepromStatus_t status, uint32_t offset);
+    uint32_t offset();
+
     // To C-string operator
     char* c_str (void);
 
 private:
     eepromStatus_t status;
+    uint32_t errorOffset;
     char szStatus[EEPROMSTATUS_BUF_LEN];
 };
 
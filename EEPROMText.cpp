@@ -0,0 +1,177 @@
+/*
+  Copyright (C) 2020 Embed Creativity LLC
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "EEPROMText.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    #include <immintrin.h>
+#endif
+
+#include <cstring>
+
+// Text bytes the block filters below let through without a closer look
+#define isPlainText(c)          ((0x20 <= (c)) && ((c) <= 0x7E))
+// Control characters allowed in text files
+#define isTextControl(c)        (('\t' == (c)) || ('\n' == (c)) || ('\r' == (c)))
+
+// Word-at-a-time helpers, each byte of a uint32_t treated as a lane
+#define ONES32                  0x01010101u
+#define HIGHS32                 0x80808080u
+// High bit set in some lane if any byte of x is below n (n <= 128)
+#define hasLess32(x, n)         (((x) - (ONES32 * (n))) & ~(x) & HIGHS32)
+// High bit set in some lane if any byte of x is zero
+#define hasZero32(x)            hasLess32(x, 1)
+
+// Byte-wise check of buf[start, end), used on blocks the fast filters flagged.
+//   Sets *inPadding once the first NUL is seen. Returns the offset of the first
+//   offending byte or end if there is none.
+static uint32_t scanBytes(const uint8_t* buf, uint32_t start, uint32_t end, bool* inPadding)
+{
+    for ( uint32_t i = start; i < end; i++ )
+    {
+        uint8_t c = buf[i];
+
+        if ( *inPadding )
+        {
+            if ( 0 != c )
+            {
+                return i;
+            }
+        }
+        else if ( 0 == c )
+        {
+            *inPadding = true;
+        }
+        else if ( !isPlainText(c) && !isTextControl(c) )
+        {
+            return i;
+        }
+    }
+    return end;
+}
+
+// Everything from start on must be NUL padding
+static uint32_t scanPadding(const uint8_t* buf, uint32_t start, uint32_t len)
+{
+    uint32_t i = start;
+    uint32_t word;
+    bool inPadding = true;
+
+    for ( ; i + sizeof(word) <= len; i += sizeof(word) )
+    {
+        std::memcpy(&word, buf + i, sizeof(word));
+        if ( 0 != word )
+        {
+            break;
+        }
+    }
+    return scanBytes(buf, i, len, &inPadding);
+}
+
+uint32_t eepromFindInvalidText(const uint8_t* buf, uint32_t len)
+{
+    uint32_t i = 0;
+    uint32_t bad;
+    bool inPadding = false;
+
+    // Text part: a block goes through the byte-wise check only if it holds a NUL, a control
+    //   character, DEL or a byte with the high bit set; anything else is plain text
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+
+    for ( ; i + 32 <= len; i += 32 )
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(buf + i));
+        // signed compare: bytes 0x80-0xFF are negative and also come out as "less than space"
+        __m256i flagged = _mm256_or_si256(_mm256_cmpgt_epi8(space, block), _mm256_cmpeq_epi8(block, del));
+
+        if ( 0 != _mm256_movemask_epi8(flagged) )
+        {
+            bad = scanBytes(buf, i, i + 32, &inPadding);
+            if ( i + 32 != bad )
+            {
+                return bad;
+            }
+            if ( inPadding )
+            {
+                return scanPadding(buf, i + 32, len);
+            }
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+
+    for ( ; i + 16 <= len; i += 16 )
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(buf + i));
+        // signed compare: bytes 0x80-0xFF are negative and also come out as "less than space"
+        __m128i flagged = _mm_or_si128(_mm_cmplt_epi8(block, space), _mm_cmpeq_epi8(block, del));
+
+        if ( 0 != _mm_movemask_epi8(flagged) )
+        {
+            bad = scanBytes(buf, i, i + 16, &inPadding);
+            if ( i + 16 != bad )
+            {
+                return bad;
+            }
+            if ( inPadding )
+            {
+                return scanPadding(buf, i + 16, len);
+            }
+        }
+    }
+#else
+    uint32_t word;
+
+    for ( ; i + sizeof(word) <= len; i += sizeof(word) )
+    {
+        std::memcpy(&word, buf + i, sizeof(word));
+        if ( 0 != ((word | hasLess32(word, 0x20) | hasZero32(word ^ (ONES32 * 0x7F))) & HIGHS32) )
+        {
+            bad = scanBytes(buf, i, i + sizeof(word), &inPadding);
+            if ( i + sizeof(word) != bad )
+            {
+                return bad;
+            }
+            if ( inPadding )
+            {
+                return scanPadding(buf, i + sizeof(word), len);
+            }
+        }
+    }
+#endif
+
+    // Whatever is left is shorter than a block
+    return scanBytes(buf, i, len, &inPadding);
+}
+
+uint32_t eepromNameHash(const char* name, uint32_t len)
+{
+    uint32_t hash = 0x811C9DC5;
+
+    // FNV-1a
+    for ( uint32_t i = 0; (i < len) && ('\0' != name[i]); i++ )
+    {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * 0x01000193;
+    }
+    return hash;
+}
+
+/******************************* EOF *******************************************/
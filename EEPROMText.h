@@ -0,0 +1,35 @@
+/*
+  Copyright (C) 2020 Embed Creativity LLC
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EEPROM_TEXT_H_
+#define EEPROM_TEXT_H_
+
+#include <cstdint>
+
+// Check that len bytes at buf are string safe file content: text characters
+//   (printable ASCII 0x20-0x7E plus tab, line feed and carriage return) optionally
+//   followed by NUL padding, with no text after the first NUL.
+//   Returns the offset of the first offending byte, or len if the content is valid.
+//   Uses AVX2 or SSE2 when the compiler targets them and 32-bit word-at-a-time
+//   arithmetic otherwise.
+uint32_t eepromFindInvalidText(const uint8_t* buf, uint32_t len);
+
+// 32-bit FNV-1a hash of the characters of name up to the first NUL, at most len of them
+uint32_t eepromNameHash(const char* name, uint32_t len);
+
+#endif /* EEPROM_TEXT_H_ */
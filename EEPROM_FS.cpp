@@ -17,46 +17,110 @@
  */
 
 #include <EEPROM_FS.h>
+#include <EEPROMCrc.h>
+#include <EEPROMText.h>
 
 // OS-dependent adapter declarations
 #if defined(__linux__)
-    #include <iostream>
-    #include <fstream>
     #include <assert.h>
+    // Writers take precedence over new readers, so a steady stream of readers cannot starve them
+    #if defined(__GLIBC__)
+        #define preferWriters(attr)    pthread_rwlockattr_setkind_np(attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP)
+    #else
+        #define preferWriters(attr)
+    #endif
     // lock initialization
-    #define initLock()    {                             \
-        assert (pthread_mutex_init(&lock, NULL) == 0);  \
+    #define initLock()    {                                     \
+        pthread_rwlockattr_t lockAttr;                          \
+        pthread_rwlockattr_init(&lockAttr);                     \
+        preferWriters(&lockAttr);                               \
+        assert (pthread_rwlock_init(&lock, &lockAttr) == 0);    \
+        pthread_rwlockattr_destroy(&lockAttr);                  \
+        assert (pthread_mutex_init(&statusLock, NULL) == 0);    \
     }
-    // non-volatile file location
-    #define UNIX_NONVOLATILE_FILE    "nonvolatile.bin"
-    #define UNIX_FILE_SIZE            2048
-    // Fake out the TI-RTOS EEPROM library API
-    #define EEPROMSizeGet()            UNIX_FILE_SIZE
-    #define EEPROM_INIT_OK            0
-    #define EEPROMInit()            EEPROM_INIT_OK
+    #include <time.h>
+    // free running millisecond clock for the write-back idle delay (only differences count)
+    static uint32_t writeBackClock()
+    {
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (static_cast<uint32_t>(now.tv_sec) * 1000u) + (now.tv_nsec / 1000000);
+    }
+    #if defined(EEPROM_FS_STATS)
+        // free running clock for the lock histograms, in microseconds (only differences count)
+        static uint32_t statsClock()
+        {
+            struct timespec now;
 
-    #define EEPROMMassErase()        FauxEEPROMMassErase()
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            return (static_cast<uint32_t>(now.tv_sec) * 1000000u) + (now.tv_nsec / 1000);
+        }
+        #define statsTicksToUs(ticks)   (ticks)
+    #endif
 
 #elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
     #include <xdc/runtime/System.h>
-    #include <driverlib/eeprom.h>
     // lock initialization
     #define initLock()    {                                             \
         Error_Block ebLock;                                             \
         Error_init(&ebLock);                                            \
         lock = Semaphore_create(1, NULL, &ebLock);                      \
-        if ( lock == NULL ) {                                           \
+        readerLock = Semaphore_create(1, NULL, &ebLock);                \
+        if ( lock == NULL || readerLock == NULL ) {                     \
             System_abort("ERROR: EEPROMFS: Semaphore creation failed"); \
         }                                                               \
+        readerCount = 0;                                                \
+    }
+    #include <ti/sysbios/knl/Clock.h>
+    #include <ti/sysbios/hal/Hwi.h>
+    // free running millisecond clock for the write-back idle delay (only differences count)
+    //   The tick count wraps at 2^32 ticks, not 2^32 ms, so elapsed ticks are accumulated
+    //   into a millisecond count that wraps cleanly. Shared by all instances.
+    static uint32_t writeBackClock()
+    {
+        static uint32_t lastTicks = 0;  // tick count at the previous call
+        static uint32_t clockMs = 0;    // milliseconds counted so far
+        static uint32_t clockUs = 0;    // microseconds not yet making up a millisecond
+        uint64_t elapsedUs;
+        uint32_t ticks;
+        uint32_t now;
+        UInt key;
+
+        key = Hwi_disable();
+        ticks = Clock_getTicks();
+        elapsedUs = (static_cast<uint64_t>(ticks - lastTicks) * Clock_tickPeriod) + clockUs;
+        lastTicks = ticks;
+        clockMs += static_cast<uint32_t>(elapsedUs / 1000);
+        clockUs = static_cast<uint32_t>(elapsedUs % 1000);
+        now = clockMs;
+        Hwi_restore(key);
+
+        return now;
     }
+    #if defined(EEPROM_FS_STATS)
+        #include <xdc/runtime/Timestamp.h>
+        #include <xdc/runtime/Types.h>
+        // free running clock for the lock histograms, in timestamp ticks (only differences count)
+        #define statsClock()            Timestamp_get32()
+        static uint32_t statsTicksToUs(uint32_t ticks)
+        {
+            Types_FreqHz freq;
+
+            Timestamp_getFreq(&freq);
+            return ticks / ((freq.lo < 1000000) ? 1 : (freq.lo / 1000000));
+        }
+    #endif
 
 #else // Assert failure
     #error Environment must either be defined as __linux__ or TIVAWARE. Add additional support for new environments as needed.
 #endif
 
-#include <algorithm>    // std::find
+#include <algorithm>    // std::min, std::max
+#include <cstddef>      // offsetof
 #include <cstdio>
 #include <cstring>
+#include <new>
 
 /************************************/
 /*   Debug Print Support            */
@@ -75,22 +139,108 @@
 #endif
 
 
-// Address in EEPROM of the file system table
-#define EEPROM_FTABLE_ADDR      0
-// Address in EEPROM of the start of the first file
-#define EEPROM_FIRST_FILE_ADDR  (EEPROM_MAX_NUM_FILES * sizeof(fileEntry_t))
+// Address in EEPROM of the first table slot
+#define EEPROM_HEADER_ADDR      0
+// Offset of the file system table within a table slot
+#define EEPROM_FTABLE_OFFSET    (sizeof(fsHeader_t))
+
+// Ring files start with a state word: offset in the ring the next byte goes to, plus
+//   EEPROM_RING_FULL once the ring has wrapped and every byte of it holds data
+#define EEPROM_RING_STATE_SIZE  4u
+#define EEPROM_RING_FULL        0x80000000u
+
+// True if sequence number a was issued after b (sequence numbers are allowed to wrap)
+#define sequenceNewer(a, b)     (static_cast<int32_t>((a) - (b)) > 0)
+
+// Instrumentation counter updates, compiled out without EEPROM_FS_STATS
+#if defined(EEPROM_FS_STATS)
+#define statsAdd(counter, n)    (stats.counter += (n))
+#else
+#define statsAdd(counter, n)
+#endif
+
+// Slot after slot in the name index (it wraps around)
+#define nextNameSlot(slot)      (((slot) + 1) & (EEPROM_NAME_INDEX_SIZE - 1))
+
+#if defined(EEPROM_FS_STATS)
+// Lock histogram bucket of a duration in microseconds (see EEPROM_STATS_BUCKETS)
+static uint32_t statsBucket(uint32_t us)
+{
+    uint32_t bucket = 0;
+
+    while ( (0 != us) && (bucket < EEPROM_STATS_BUCKETS - 1) )
+    {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+#endif
+
+// Length of name, or EEPROM_MAX_NAME_LEN if it does not fit a directory entry
+static uint32_t nameLength(const char* name)
+{
+    uint32_t len = 0;
+
+    while ( (len < EEPROM_MAX_NAME_LEN) && ('\0' != name[len]) )
+    {
+        len++;
+    }
+    return len;
+}
 
 
-EEPROMFS::EEPROMFS () :
+EEPROMFS::EEPROMFS (EEPROMBackend* backend, uint32_t imageSize) :
+#if defined(__linux__)
+    defaultBackend(UNIX_NONVOLATILE_FILE, (0 != imageSize) ? imageSize : UNIX_FILE_SIZE),
+#endif
+    backend(backend),
+    numFiles(0),
+    slotSize(0),
+    currentSlot(0),
+    firstFileAddr(0),
+    wordAlignedDisk(NULL),
     disk(NULL),
-    readWriteIndex(0),
+    dirtyCount(0),
     hwInitialized(false),
     ready(false),
     writeEnabled(false),
-    eepromSize(0),
+    eepromSize(imageSize),
     bytesUsed(0),
-    validFileSystemTable(false)
+    activeFileCount(0),
+    quarantinedFileCount(0),
+    validFileSystemTable(false),
+    writeBack(false),
+    writeBackIdleMs(EEPROM_WRITEBACK_IDLE_MS),
+    writeBackMaxDirty(EEPROM_WRITEBACK_MAX_DIRTY),
+    syncPending(false),
+    lastUpdateAt(0)
+#if defined(EEPROM_FS_SNAPSHOTS)
+    , currentSnapshot(NULL)
+#endif
 {
+    std::memset(&header, 0, sizeof(header));
+    std::memset(fileTable, 0, sizeof(fileTable));
+    resetActiveFiles();
+    std::memset(quarantineBitmap, 0, sizeof(quarantineBitmap));
+    std::memset(handleManager, 0, sizeof(handleManager));
+    std::memset(nameIndex, 0xFF, sizeof(nameIndex));
+#if defined(EEPROM_FS_STATS)
+    std::memset(&stats, 0, sizeof(stats));
+    lockTakenAt = 0;
+#endif
+#if defined(EEPROM_FS_WEAR)
+    wearCounters = NULL;
+    wearImage = NULL;
+    wearBlocks = 0;
+#endif
+#if defined(EEPROM_FS_SNAPSHOTS)
+    std::memset(snapshots, 0, sizeof(snapshots));
+#endif
+    if ( NULL == this->backend )
+    {
+        this->backend = &defaultBackend;
+    }
     initLock();
     getLock();
     ready = init();
@@ -100,20 +250,32 @@ EEPROMFS::EEPROMFS () :
 EEPROMFS::~EEPROMFS()
 {
     getLock();
+    // last chance for updates write-back mode held back
+    if ( syncPending && validFileSystemTable )
+    {
+        commitTable();
+    }
     if ( wordAlignedDisk != NULL )
     {
         delete[] wordAlignedDisk;
         wordAlignedDisk = NULL;
         disk = NULL;
     }
-    // Clean up all handles and managers from map: handleManager
-    for ( std::map<int, manager_t*>::iterator it = handleManager.begin(); it != handleManager.end(); it++ )
+#if defined(EEPROM_FS_WEAR)
+    delete[] wearCounters;
+    wearCounters = NULL;
+    delete[] wearImage;
+    wearImage = NULL;
+#endif
+#if defined(EEPROM_FS_SNAPSHOTS)
+    // all readers must have released their snapshots by now
+    currentSnapshot = NULL;
+    for ( uint32_t i = 0; i < EEPROM_SNAPSHOT_POOL_SIZE; i++ )
     {
-        // clean up the handle that the manager is holding
-        delete it->second->handle;
-        // clean up the manager itself
-        delete it->second;
+        delete snapshots[i];
+        snapshots[i] = NULL;
     }
+#endif
     releaseLock();
 }
 
@@ -156,9 +318,9 @@ uint32_t EEPROMFS::getActiveFileCount()
     if ( !validFileSystemTable )
     {
         status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
-        activeFiles.clear();
+        resetActiveFiles();
     }
-    return activeFiles.size();
+    return activeFileCount;
 }
 
 EEPROMStatus EEPROMFS::getStatus() // TODO: Am I making a copy of the entire class here? Pass by reference?
@@ -166,16 +328,33 @@ EEPROMStatus EEPROMFS::getStatus() // TODO: Am I making a copy of the entire cla
     return status;
 }
 
-const std::map<uint8_t, uint16_t> EEPROMFS::getActiveFiles()
+uint32_t EEPROMFS::getMaxFileCount()
+{
+    return numFiles;
+}
+
+uint32_t EEPROMFS::getQuarantinedFileCount()
+{
+    return quarantinedFileCount;
+}
+
+bool EEPROMFS::isQuarantined(fileId_t fileId)
+{
+    if ( numFiles <= fileId )
+    {
+        return false;
+    }
+    return (0 != (quarantineBitmap[fileId >> 5] & (1u << (fileId & 0x1F))));
+}
+
+const std::map<fileId_t, eepromAddr_t> EEPROMFS::getActiveFiles()
 {
-    std::map<uint8_t, uint16_t> retSet;
+    std::map<fileId_t, eepromAddr_t> retSet;
 
-    for (std::set<uint8_t, std::less<uint8_t> >::iterator it = activeFiles.begin();
-        it != activeFiles.end(); ++it)
+    for ( fileId_t id = firstActiveFile(); id != EEPROM_NO_FILE; id = nextActiveFile(id) )
     {
-        uint8_t id = *it;
-        uint16_t size = fileTable[*it].size;
-        retSet.insert(std::pair<uint8_t, uint16_t>(id, size));
+        eepromAddr_t size = fileTable[id].size;
+        retSet.insert(std::pair<fileId_t, eepromAddr_t>(id, size));
     }
 
     return retSet;
@@ -183,9 +362,7 @@ const std::map<uint8_t, uint16_t> EEPROMFS::getActiveFiles()
 
 handle_t* EEPROMFS::open(int index)
 {
-    handle_t* tempHandle;
-    manager_t* tempManager;
-    std::map<int, manager_t*>::iterator it;
+    handle_t* handle;
 
     getLock();
 
@@ -197,121 +374,189 @@ handle_t* EEPROMFS::open(int index)
     }
 
     // Bounds check user input
-    if (0 > index || index >= EEPROM_MAX_NUM_FILES)
+    if (0 > index || index >= numFiles)
     {
         status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
         releaseLock();
         return NULL;
     }
 
-    // Verify that the file has exists
-    std::set<uint8_t, std::less<uint8_t> >::iterator fit;
-    fit = std::find(activeFiles.begin(), activeFiles.end(), index);
-    if (fit == activeFiles.end())
+    handle = openFile(index);
+    releaseLock();
+    return handle;
+}
+
+handle_t* EEPROMFS::open(const char* name)
+{
+    handle_t* handle;
+    uint32_t entry;
+
+    getLock();
+
+    if ( !validFileSystemTable )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return NULL;
+    }
+    if ( (0 == (header.flags & EEPROM_FS_FLAG_NAMES)) || (NULL == name) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
         releaseLock();
         return NULL;
     }
 
-    // Look for object managing file at given index
-    it = handleManager.find(index);
-
-    // If we don't have it in our map, we have to create a manager for it
-    if ( it == handleManager.end() )
+    entry = findName(name);
+    if ( EEPROM_NO_FILE == entry )
     {
-        tempHandle = new (std::nothrow) handle_t;
-        if ( NULL == tempHandle )
-        {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_MEMORY);
-            releaseLock();
-            return NULL;
-        }
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        releaseLock();
+        return NULL;
+    }
 
-        // Create a manager for this file handle
-        tempManager = new (std::nothrow) manager_t;
-        if ( NULL == tempManager )
-        {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_MEMORY);
-            releaseLock();
-            return NULL;
-        }
+    handle = openFile(((const dirEntry_t *)(disk + fileTable[numFiles - 1].startAddress))[entry].fileId);
+    releaseLock();
+    return handle;
+}
 
-        tempManager->handle = tempHandle;
-        tempManager->handleCount = 1; // first customer!
+fileId_t EEPROMFS::lookup(const char* name)
+{
+    fileId_t fileId = EEPROM_NO_FILE;
+    uint32_t entry;
 
-        // insert manager into the map for this index
-        handleManager[index] = tempManager;
+    getLock();
 
-        // Populate handle with file info
-        if ( ! updateHandle(index) )
-        {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-            releaseLock();
-            return NULL;
-        }
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return EEPROM_NO_FILE;
+    }
+    if ( (0 == (header.flags & EEPROM_FS_FLAG_NAMES)) || (NULL == name) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
         releaseLock();
+        return EEPROM_NO_FILE;
+    }
 
-        // return handle to calling task
-        return tempHandle;
+    entry = findName(name);
+    if ( EEPROM_NO_FILE == entry )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
     }
-    // If we already have a manager for the file, increment reference count and return existing handle found
     else
     {
-        // increment the reference count to the handle
-        it->second->handleCount += 1;
-        // return the handle to the calling task
-        releaseLock();
-        return it->second->handle;
+        fileId = ((const dirEntry_t *)(disk + fileTable[numFiles - 1].startAddress))[entry].fileId;
+        status.setStatus(EEPROMStatus::EEPROM_OK);
     }
+
+    releaseLock();
+    return fileId;
 }
 
 void EEPROMFS::close(int index)
 {
-    manager_t* tempManager;
-    std::map<int, manager_t*>::iterator it;
+    // Ignore indexes we could never have handed out a handle for
+    if ( 0 > index || index >= EEPROM_MAX_NUM_FILES )
+    {
+        return;
+    }
 
-    // Look for object managing file at given index
-    it = handleManager.find(index);
+    getLock();
 
-    // If we have it in our map, we need to decrement access count and possibly garbage collect
-    if ( it != handleManager.end() )
+    // There needs to be at least one reference to this handle
+    if ( 0 < handleManager[index].handleCount )
     {
-        tempManager = it->second;
+        // decrement the reference count to the handle
+        handleManager[index].handleCount -= 1;
+    }
+    // No more references to the handle, it can be reset
+    if ( 0 == handleManager[index].handleCount )
+    {
+        handleManager[index].handle.data = NULL;
+        handleManager[index].handle.size = 0;
+        handleManager[index].handle.flags = 0;
+    }
 
-        // There needs to be at least one reference to this handle
-        if ( 0 < tempManager->handleCount )
-        {
-            // decrement the reference count to the handle
-            tempManager->handleCount -= 1;
-        }
-        // No more references to the handle, it can be cleaned up
-        if ( 0 == tempManager->handleCount )
-        {
-            delete tempManager->handle; // garbage collect handle
-            tempManager->handle = NULL; // reset to NULL
-            handleManager.erase(it); // remove file manager from map by iterator
-            delete tempManager; // garbage collect manager
-            tempManager = NULL;
-        }
+    releaseLock();
+}
+
+void  EEPROMFS::getReadLock(void)
+{
+#if defined(__linux__)
+    pthread_rwlock_rdlock(&lock);
+#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
+    Semaphore_pend(readerLock, BIOS_WAIT_FOREVER);
+    if ( 0 == readerCount++ )
+    {
+        Semaphore_pend(lock, BIOS_WAIT_FOREVER);
+    }
+    Semaphore_post(readerLock);
+#else // Assert failure
+    #error Environment must either be defined as __linux__ or TIVAWARE. Add additional support for new environments as needed.
+#endif
+}
+
+void  EEPROMFS::releaseReadLock(void)
+{
+#if defined(__linux__)
+    pthread_rwlock_unlock(&lock);
+#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
+    Semaphore_pend(readerLock, BIOS_WAIT_FOREVER);
+    if ( 0 == --readerCount )
+    {
+        Semaphore_post(lock);
     }
+    Semaphore_post(readerLock);
+#else // Assert failure
+    #error Environment must either be defined as __linux__ or TIVAWARE. Add additional support for new environments as needed.
+#endif
+}
+
+void EEPROMFS::setReadStatus(EEPROMStatus::eepromStatus_t value)
+{
+#if defined(__linux__)
+    pthread_mutex_lock(&statusLock);
+    status.setStatus(value);
+    pthread_mutex_unlock(&statusLock);
+#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
+    Semaphore_pend(readerLock, BIOS_WAIT_FOREVER);
+    status.setStatus(value);
+    Semaphore_post(readerLock);
+#else // Assert failure
+    #error Environment must either be defined as __linux__ or TIVAWARE. Add additional support for new environments as needed.
+#endif
 }
 
 void  EEPROMFS::getLock(void)
 {
+#if defined(EEPROM_FS_STATS)
+    uint32_t waitStart = statsClock();
+#endif
+
 #if defined(__linux__)
-    pthread_mutex_lock(&lock);
+    pthread_rwlock_wrlock(&lock);
 #elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
     Semaphore_pend(lock, BIOS_WAIT_FOREVER);
 #else // Assert failure
     #error Environment must either be defined as __linux__ or TIVAWARE. Add additional support for new environments as needed.
 #endif
+
+#if defined(EEPROM_FS_STATS)
+    lockTakenAt = statsClock();
+    stats.lockAcquisitions++;
+    stats.lockWait[statsBucket(statsTicksToUs(lockTakenAt - waitStart))]++;
+#endif
 }
 
 void  EEPROMFS::releaseLock(void)
 {
+#if defined(EEPROM_FS_STATS)
+    stats.lockHold[statsBucket(statsTicksToUs(statsClock() - lockTakenAt))]++;
+#endif
+
 #if defined(__linux__)
-    pthread_mutex_unlock(&lock);
+    pthread_rwlock_unlock(&lock);
 #elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
     Semaphore_post(lock);
 #else // Assert failure
@@ -319,810 +564,3076 @@ void  EEPROMFS::releaseLock(void)
 #endif
 }
 
-bool EEPROMFS::writeFile(uint8_t fileId, uint8_t* writeBuf, uint16_t bufLen)
+bool EEPROMFS::setWriteBack(bool enable, uint32_t idleMs, uint32_t maxDirtyBytes)
 {
-    std::set<uint8_t, std::less<uint8_t> >::iterator it;
+    bool success = true;
 
     getLock();
-
-    if ( !validFileSystemTable )
-    {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
-        releaseLock();
-        return false;
-    }
-    if ( !ready )
-    {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
-        releaseLock();
-        return false;
-    }
-    if ( !writeEnabled )
-    {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
-        releaseLock();
-        return false;
-    }
-    if ( EEPROM_MAX_NUM_FILES <= fileId )
+    writeBack = enable;
+    writeBackIdleMs = idleMs;
+    writeBackMaxDirty = maxDirtyBytes;
+    if ( !enable && syncPending )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
-        releaseLock();
-        return false;
+        success = commitTable();
     }
+    releaseLock();
 
-    // disable to protect against follow up write call
-    writeEnabled = false;
+    return success;
+}
 
-    // check to see if file is in the activeFiles set
-    it = std::find(activeFiles.begin(), activeFiles.end(), fileId);
+bool EEPROMFS::sync()
+{
+    bool success = true;
 
-    // File does not exist in set yet
-    if ( it == activeFiles.end() )
+    getLock();
+    if ( syncPending )
     {
-        // if file is not, then check if eepromSize and bytesUsed can accommodate this new file
-        if ( bufLen + bytesUsed > eepromSize )
-        {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
-            releaseLock();
-            return false;
-        }
-        // Iterate through the files that ARE there, and find where we need to start moving files out to make room
-        // We do this by iterating through and finding the start of what comes AFTER our target file
-        std::set<uint8_t, std::less<uint8_t> >::iterator itrCopy = activeFiles.begin();
-        for ( it = activeFiles.begin(); it != activeFiles.end() && *it < fileId; it++ )
-        {
-            itrCopy = it;
-        }
-        // See if our new file is going to be the FIRST file
-        if ( it == activeFiles.begin() )
-        {
-            // Check if our new file is the ONLY file in the system.
-            //   If the new file is NOT the only file in the system,
-            //   we're going to have to move data to make room
-            if ( 0 != getActiveFileCount() )
-            {
-                // Starting from the last file and moving towards the front, move each file to the "right"
-                for ( std::set<uint8_t, std::less<uint8_t> >::reverse_iterator rit = activeFiles.rbegin();
-                      rit != activeFiles.rend(); ++rit )
-                {
-                    uint8_t* headPtr = disk + fileTable[*rit].startAddress;
-                    if ( ! shiftFileData(headPtr, fileTable[*rit].size, bufLen) )
-                    {
-                        releaseLock();
-                        return false;
-                    }
-                    fileTable[*rit].startAddress += bufLen; // advance starting position
-                    updateHandle(*rit); // update any handles that have this affected file
-                }
-            }
-            // Write out file data to file table and disk
-            fileTable[fileId].size = bufLen;
-            fileTable[fileId].startAddress = EEPROM_FIRST_FILE_ADDR;
-            std::memcpy(&disk[EEPROM_FIRST_FILE_ADDR], writeBuf, bufLen);
-            activeFiles.insert(fileId);
-            write(disk, 0, eepromSize); // write out entire disk image
-            updateHandle(fileId);
-            bytesUsed += bufLen; // add to the total bytesUsed tracker
-        }
-        //   File will NOT be the first or last file - move the trailing files to make room
-        else if ( it != activeFiles.end() )
-        {
-            // itrCopy points at what precedes our new file
-            // it points to what comes after
-
-            // Starting from the last file and moving towards the front and stopping at file would come
-            //   before our new file, move each file to the "right"
-            std::set<uint8_t, std::less<uint8_t> >::reverse_iterator ritHead = std::find(activeFiles.rbegin(),
-                                                                                        activeFiles.rend(), *itrCopy);
-
-            for ( std::set<uint8_t, std::less<uint8_t> >::reverse_iterator rit = activeFiles.rbegin();
-                  rit != ritHead; ++rit )
-            {
-                uint8_t* headPtr = disk + fileTable[*rit].startAddress;
-                if ( ! shiftFileData(headPtr, fileTable[*rit].size, bufLen) )
-                {
-                    releaseLock();
-                    return false;
-                }
-                fileTable[*rit].startAddress += bufLen; // advance starting position
-                updateHandle(*rit); // update any handles that have this affected file
-            }
-
-            // Write out file data to file table and disk
-            fileTable[fileId].size = bufLen;
-            // starting address comes directly after the file that precedes it
-            fileTable[fileId].startAddress = fileTable[*itrCopy].startAddress + fileTable[*itrCopy].size;
-            std::memcpy(&disk[fileTable[fileId].startAddress], writeBuf, bufLen);
-            activeFiles.insert(fileId);
-            write(disk, 0, eepromSize); // write out entire disk image
-            updateHandle(fileId);
-            bytesUsed += bufLen; // add to the total bytesUsed tracker
-        }
-        // New file will be at the end. Copy writeBuf data directly after the last file present
-        else
-        {
-            // assign iterator to the end of the set
-            std::set<uint8_t, std::less<uint8_t> >::reverse_iterator rit = activeFiles.rbegin();
-            // Write out file data to file table and disk
-            fileTable[fileId].size = bufLen;
-            // starting address comes directly after the file that precedes it
-            fileTable[fileId].startAddress = fileTable[*rit].startAddress + fileTable[*rit].size;
-            std::memcpy(&disk[fileTable[fileId].startAddress], writeBuf, bufLen);
-            activeFiles.insert(fileId);
-            write(disk, 0, eepromSize); // write out entire disk image
-            updateHandle(fileId);
-            bytesUsed += bufLen; // add to the total bytesUsed tracker
-        }
+        // Call to write() will set the EEPROM status property
+        success = commitTable();
     }
-    // else, file already exists
     else
     {
-        int32_t distance;
+        status.setStatus(EEPROMStatus::EEPROM_OK);
+    }
+    releaseLock();
 
-        // Ignore current size of file, as we're replacing it
-        if ( bytesUsed - fileTable[fileId].size + bufLen > eepromSize )
-        {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
-            releaseLock();
-            return false;
-        }
+    return success;
+}
 
-        // Nuke the original to prevent trailing characters
-        std::memset(&disk[fileTable[fileId].startAddress], 0xFF, fileTable[fileId].size);
+bool EEPROMFS::syncIfIdle()
+{
+    bool success = true;
 
-        // find the change in file size
-        distance = bufLen - fileTable[fileId].size;
+    getLock();
+    if ( syncPending && (writeBackClock() - lastUpdateAt >= writeBackIdleMs) )
+    {
+        success = commitTable();
+    }
+    releaseLock();
 
-        // If our file was the "last" file or the size is not changing, simply stick it in place
-        if ( (distance == 0) || (it == activeFiles.end()) )
-        {
-            // Write new file data
-            std::memcpy(&disk[fileTable[fileId].startAddress], writeBuf, bufLen);
+    return success;
+}
 
-            // Update file table info
-            fileTable[fileId].size = bufLen;
-            updateHandle(fileId);
-            bytesUsed += distance; // adjust based on change
+bool EEPROMFS::isSyncPending()
+{
+    bool pending;
 
-            write(disk, 0, eepromSize); // write out entire disk image
-            updateHandle(fileId);
-        }
-        // file was not the "last" in the system and/or the size has changed with this update
-        else
-        {
-            if ( 0 > distance ) // new file is smaller
-            {
-                // advance "it" iterator to what comes 'after' our file (all the ones we'd need to move)
-                it++;
+    getLock();
+    pending = syncPending;
+    releaseLock();
 
-                // Starting from the file after our target file and moving towards the end, adjust the position of each file
-                for ( std::set<uint8_t, std::less<uint8_t> >::iterator itMover = it;
-                    itMover != activeFiles.end(); ++itMover )
-                {
-                    uint8_t* headPtr = disk + fileTable[*itMover].startAddress;
-                    if ( ! shiftFileData(headPtr, fileTable[*itMover].size, distance) )
-                    {
-                        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-                        releaseLock();
-                        return false;
-                    }
-                    fileTable[*itMover].startAddress += distance; // adjust starting position
-                    updateHandle(*itMover); // update any handles that have this affected file
-                }
-            }
-            else // new file is larger
-            {
-                // Starting from the last file and moving towards the front, move each file to the "right"
-                for ( std::set<uint8_t, std::less<uint8_t> >::reverse_iterator rit = activeFiles.rbegin();
-                      *rit != *it; ++rit )
-                {
-                    uint8_t* headPtr = disk + fileTable[*rit].startAddress;
-                    if ( ! shiftFileData(headPtr, fileTable[*rit].size, distance) )
-                    {
-                        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-                        releaseLock();
-                        return false;
-                    }
-                    fileTable[*rit].startAddress += distance; // adjust starting position
-                    updateHandle(*rit); // update any handles that have this affected file
-                }
-            }
+    return pending;
+}
 
-            // Write out updated file data to file table and disk (starting address does not change)
-            fileTable[fileId].size = bufLen;
-            std::memcpy(&disk[fileTable[fileId].startAddress], writeBuf, bufLen);
-            write(disk, 0, eepromSize); // write out entire disk image
-            updateHandle(fileId);
-            bytesUsed += distance; // adjust based on change
-        }
-    }
+#if defined(EEPROM_FS_STATS)
+eepromStats_t EEPROMFS::getStats()
+{
+    eepromStats_t copy;
 
+    getLock();
+    copy = stats;
     releaseLock();
-    return true;
+    return copy;
 }
 
-bool EEPROMFS::deleteFile(uint8_t fileId)
+void EEPROMFS::resetStats()
 {
-   std::set<uint8_t, std::less<uint8_t> >::iterator it;
-   int32_t distance;
-
     getLock();
+    std::memset(&stats, 0, sizeof(stats));
+    releaseLock();
+}
+#endif
 
-    if ( !validFileSystemTable )
+#if defined(EEPROM_FS_WEAR)
+void EEPROMFS::countWear(uint32_t startAddress, uint32_t len)
+{
+    uint32_t last = (startAddress + len - 1) / EEPROM_WEAR_BLOCK_SIZE;
+
+    for ( uint32_t block = startAddress / EEPROM_WEAR_BLOCK_SIZE; (0 != len) && (block <= last); block++ )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
-        releaseLock();
-        return false;
+        wearCounters[block]++;
     }
-    if ( !ready )
+}
+
+uint32_t EEPROMFS::getHottestBlocks(wearBlock_t* blocks, uint32_t maxBlocks)
+{
+    uint32_t count = 0;
+
+    if ( NULL == blocks )
+    {
+        return 0;
+    }
+
+    getLock();
+    if ( NULL == wearCounters )
+    {
+        releaseLock();
+        return 0;
+    }
+    // insertion into the (short) result list, which stays sorted hottest first
+    for ( uint32_t block = 0; block < wearBlocks; block++ )
+    {
+        uint32_t programs = wearCounters[block];
+        uint32_t pos;
+
+        if ( (0 == programs) || ((count == maxBlocks) && ((0 == count) || (programs <= blocks[count - 1].programs))) )
+        {
+            continue;
+        }
+        pos = (count < maxBlocks) ? count++ : (count - 1);
+        while ( (0 < pos) && (blocks[pos - 1].programs < programs) )
+        {
+            blocks[pos] = blocks[pos - 1];
+            pos--;
+        }
+        blocks[pos].address = block * EEPROM_WEAR_BLOCK_SIZE;
+        blocks[pos].programs = programs;
+    }
+    releaseLock();
+
+    return count;
+}
+
+uint32_t EEPROMFS::getRemainingCycles(uint32_t endurance)
+{
+    wearBlock_t hottest;
+
+    if ( 0 == getHottestBlocks(&hottest, 1) )
+    {
+        return endurance;
+    }
+    return (hottest.programs < endurance) ? (endurance - hottest.programs) : 0;
+}
+
+uint64_t EEPROMFS::forecastRemainingLife(uint64_t elapsed, uint32_t endurance)
+{
+    wearBlock_t hottest;
+
+    if ( 0 == getHottestBlocks(&hottest, 1) )
+    {
+        return UINT64_MAX;
+    }
+    if ( hottest.programs >= endurance )
+    {
+        return 0;
+    }
+    // the hottest block keeps its rate of programs per unit of elapsed
+    return ((endurance - hottest.programs) * elapsed) / hottest.programs;
+}
+
+bool EEPROMFS::saveWearCounters(fileId_t fileId)
+{
+    getLock();
+    if ( NULL == wearCounters )
     {
         status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        writeEnabled = false;
         releaseLock();
         return false;
     }
-    if ( !writeEnabled )
+    // file layout: block size, number of blocks, one counter per block
+    wearImage[0] = EEPROM_WEAR_BLOCK_SIZE;
+    wearImage[1] = wearBlocks;
+    std::memcpy(&wearImage[2], wearCounters, wearBlocks * sizeof(uint32_t));
+    releaseLock();
+
+    // writeFile() checks the file id and the write enable
+    return writeFile(fileId, (uint8_t*)wearImage, (2 + wearBlocks) * sizeof(uint32_t), EEPROM_FILE_FLAG_BINARY);
+}
+
+bool EEPROMFS::loadWearCounters(fileId_t fileId)
+{
+    const uint8_t* data;
+    uint32_t header[2];
+
+    getLock();
+    if ( !validFileSystemTable )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
         releaseLock();
         return false;
     }
-    if ( EEPROM_MAX_NUM_FILES <= fileId )
+    if ( (NULL == wearCounters) || (numFiles <= fileId) )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        status.setStatus((NULL == wearCounters) ? EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED :
+                                                  EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
         releaseLock();
         return false;
     }
-
-    // disable to protect against follow up write call
-    writeEnabled = false;
-
-    // check to see if file is in the activeFiles set
-    it = std::find(activeFiles.begin(), activeFiles.end(), fileId);
-
-    // File does not exist in set
-    if ( it == activeFiles.end() )
+    if ( !isActive(fileId) )
     {
         status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
         releaseLock();
         return false;
     }
-
-    // create distance to move files
-    distance = (-1 * fileTable[fileId].size);
-
-    // Verify the file was not disabled (zero length size)
-    if ( fileTable[fileId].size == 0 )
+    if ( isQuarantined(fileId) )
     {
-        fileTable[fileId].startAddress = 0;
-        activeFiles.erase(fileId);
-        updateHandle(fileId);
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
         releaseLock();
-        return true;
+        return false;
+    }
+    // only counters saved with the same block geometry line up with ours
+    data = disk + fileTable[fileId].startAddress;
+    std::memcpy(header, data, sizeof(header));
+    if ( (fileTable[fileId].size != (2 + wearBlocks) * sizeof(uint32_t)) ||
+         (EEPROM_WEAR_BLOCK_SIZE != header[0]) || (wearBlocks != header[1]) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
+        releaseLock();
+        return false;
     }
+    for ( uint32_t block = 0; block < wearBlocks; block++ )
+    {
+        uint32_t programs;
 
-    // Nuke the file
-    std::memset(&disk[fileTable[fileId].startAddress], 0xFF, fileTable[fileId].size);
-    // Reclaim size
-    bytesUsed -= fileTable[fileId].size;
+        std::memcpy(&programs, data + ((2 + block) * sizeof(uint32_t)), sizeof(programs));
+        wearCounters[block] = (programs > UINT32_MAX - wearCounters[block]) ? UINT32_MAX :
+                                                                              (wearCounters[block] + programs);
+    }
+    status.setStatus(EEPROMStatus::EEPROM_OK);
+    releaseLock();
 
-    // invalidate file table entry
-    fileTable[fileId].startAddress = 0;
-    fileTable[fileId].size = 0;
-    updateHandle(fileId);
+    return true;
+}
+#endif
 
-    // iterator "it" points to index in activeFiles array
-    // advance "it" iterator to what comes 'after' our file (all the ones we'd need to move)
-    // Starting from the file after our target file and moving towards the end, adjust the position of each file
-    for ( it++ ; it != activeFiles.end(); ++it )
+#if defined(EEPROM_FS_SNAPSHOTS)
+const EEPROMSnapshot* EEPROMFS::acquireSnapshot()
+{
+    for ( ;; )
     {
-        uint8_t* headPtr = disk + fileTable[*it].startAddress;
-        if ( ! shiftFileData(headPtr, fileTable[*it].size, distance) )
+        EEPROMSnapshot* snapshot = currentSnapshot.load();
+
+        if ( NULL == snapshot )
         {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-            releaseLock();
-            return false;
+            return NULL;
+        }
+        snapshot->readers++;
+        // A writer may have recycled the snapshot between the two steps above. Once our
+        //   count is in and it is still current it can no longer be recycled under us.
+        if ( snapshot == currentSnapshot.load() )
+        {
+            return snapshot;
         }
-        fileTable[*it].startAddress += distance; // adjust starting position
-        updateHandle(*it); // update any handles that have this affected file
+        snapshot->readers--;
     }
+}
 
-    activeFiles.erase(fileId);
-    write(disk, 0, eepromSize); // write out entire disk image
-    releaseLock();
-    return true;
+void EEPROMFS::releaseSnapshot(const EEPROMSnapshot* snapshot)
+{
+    if ( NULL != snapshot )
+    {
+        const_cast<EEPROMSnapshot*>(snapshot)->readers--;
+    }
 }
+#endif
 
-bool EEPROMFS::format()
+bool EEPROMFS::writeFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags)
 {
-    bool success = false;
+    bool success;
 
     getLock();
 
-    if ( !hwInitialized )
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
     {
         status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        releaseLock();
+        return false;
     }
-    else if ( !writeEnabled )
+    if ( !writeEnabled )
     {
         status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
     }
-    else
+    // Ring files are only made by createRingFile()
+    if ( (numFiles <= fileId) || isReserved(fileId) || (0 != (fileFlags & ~EEPROM_FILE_FLAGS)) ||
+         (0 != (fileFlags & EEPROM_FILE_FLAG_RING)) )
     {
-        writeEnabled = false;
-        if ( formatEEPROM() )
-        {
-            // re-verify the filesystem table
-            validFileSystemTable = validateFileSystem();
-            success = validFileSystemTable;
-        }
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseLock();
+        return false;
     }
 
-    releaseLock();
+    // disable to protect against follow up write call
+    writeEnabled = false;
 
+    // A file can never be larger than the image (this also guards the sums below)
+    if ( bufLen > eepromSize )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+        releaseLock();
+        return false;
+    }
+
+    // Ignore current size of file (if any), as we're replacing it
+    if ( bytesUsed - (isActive(fileId) ? fileTable[fileId].size : 0) + bufLen > eepromSize )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+        releaseLock();
+        return false;
+    }
+    if ( !checkText(writeBuf, bufLen, fileFlags) )
+    {
+        releaseLock();
+        return false;
+    }
+
+    success = storeFile(fileId, writeBuf, bufLen, fileFlags);
+    releaseLock();
     return success;
 }
 
-/*****************************************************************************************************/
-/* Private                                                                                           */
-/*****************************************************************************************************/
-
-uint32_t EEPROMFS::read( uint8_t* buf, uint32_t startAddress, uint32_t len )
+bool EEPROMFS::appendToFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen)
 {
-    uint32_t readLen;
+    uint32_t size;
+    uint32_t offset;
+    uint32_t growth;
+    bool success;
 
-    if ( !hwInitialized )
+    getLock();
+
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
     {
         status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
-        return 0;
+        releaseLock();
+        return false;
     }
-
-    // Check for correct word alignment prior to making API calls
-    // Must be a multiple of 4
-    if ( 0 != (startAddress & 0x03) || 0 != (len & 0x03) )
+    if ( !writeEnabled )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_WORD_ALIGNMENT);
-        return 0;
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
+    }
+    if ( (numFiles <= fileId) || isReserved(fileId) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseLock();
+        return false;
     }
 
-    if ( startAddress + len > eepromSize )
+    // disable to protect against follow up write call
+    writeEnabled = false;
+
+    if ( !isActive(fileId) )
     {
-        readLen = eepromSize - startAddress;
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        releaseLock();
+        return false;
     }
-    else
+    if ( isQuarantined(fileId) )
     {
-        readLen = len;
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
+        releaseLock();
+        return false;
     }
 
-#if defined(__linux__)
-    std::fstream fs;
-    int32_t size;
-
-    // Open the file without std::ios::in first to ensure it's created if it doesn't exist
-    fs.open(UNIX_NONVOLATILE_FILE, std::ios::out | std::ios::binary | std::ios::app);
-    if ( !fs.is_open() )
+    // Ring files have a fixed size, the data just goes round
+    if ( 0 != (fileTable[fileId].flags & EEPROM_FILE_FLAG_RING) )
     {
-        fs.close();
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
+        success = appendRing(fileId, writeBuf, bufLen);
+        releaseLock();
+        return success;
     }
-    fs.close();
-    // Reopen it with std::ios::in and with std::ios::ate to open it with the cursor at the end
-    fs.open(UNIX_NONVOLATILE_FILE, std::ios::in | std::ios::binary | std::ios::ate);
 
-    if (fs.is_open())
+    if ( !checkText(writeBuf, bufLen, fileTable[fileId].flags) )
     {
-        size = fs.tellg();
-        // check for epic failure
-        if ( -1 == size )
-        {
-            fs.close();
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-            return 0;
-        }
+        releaseLock();
+        return false;
+    }
 
-        // Ensure the size is as expected
-        if ( static_cast<uint32_t>(size) != eepromSize )
+    // Text goes after the text, over the NUL padding: behind it, it would be text after a NUL
+    size = fileTable[fileId].size;
+    offset = size;
+    if ( 0 == (fileTable[fileId].flags & EEPROM_FILE_FLAG_BINARY) )
+    {
+        while ( (0 < offset) && (0 == disk[fileTable[fileId].startAddress + offset - 1]) )
         {
-            fs.close();
-            // nuke entire EEPROM - set to FF's
-            if ( 0 != EEPROMMassErase() )
-            {
-                status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-                return 0;
-            }
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
-            return 0;
+            offset--;
         }
-
-        // Move cursor to where the caller wanted it
-        fs.seekg(startAddress, std::ios::beg);
-        // Read out to the memory location passed in
-        fs.read ((char*)buf, readLen);
-        fs.close();
     }
-    else
+
+    // The file grows by whatever does not fit into the padding (the first test also guards the sums)
+    growth = (bufLen > eepromSize) ? bufLen : (std::max(offset + bufLen, size) - size);
+    if ( (bufLen > eepromSize) || (bytesUsed + growth > eepromSize) )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-        return 0;
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+        releaseLock();
+        return false;
     }
 
-#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
-    EEPROMRead((uint32_t*)buf, startAddress, readLen);
-#else // Assert failure
-    #error Environment must either be defined as __linux__ or TIVAWARE. Add additional support for new environments as needed.
-#endif
-
-    status.setStatus(EEPROMStatus::EEPROM_OK);
-    return readLen;
+    success = extendFile(fileId, offset, writeBuf, bufLen);
+    releaseLock();
+    return success;
 }
 
-bool EEPROMFS::write( uint8_t* buf, uint32_t startAddress, uint32_t len )
+bool EEPROMFS::createRingFile(fileId_t fileId, uint32_t capacity)
 {
+    bool success;
 
-    if ( !hwInitialized )
+    getLock();
+
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
     {
         status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        releaseLock();
+        return false;
+    }
+    if ( !writeEnabled )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
+    }
+    if ( (numFiles <= fileId) || isReserved(fileId) || (0 == capacity) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseLock();
         return false;
     }
 
-    // Check for correct word alignment prior to making API calls
-    // Must be a multiple of 4
-    if ( 0 != (startAddress & 0x03) || 0 != (len & 0x03) )
+    // disable to protect against follow up write call
+    writeEnabled = false;
+
+    // The whole reservation is taken up front (the first test also guards the sum in the second)
+    if ( (capacity > eepromSize) ||
+         (bytesUsed - (isActive(fileId) ? fileTable[fileId].size : 0) + EEPROM_RING_STATE_SIZE + capacity > eepromSize) )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_WORD_ALIGNMENT);
-        return 0;
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+        releaseLock();
+        return false;
+    }
+
+    // An all zero state word is an empty ring
+    success = storeFile(fileId, NULL, EEPROM_RING_STATE_SIZE + capacity, EEPROM_FILE_FLAG_RING | EEPROM_FILE_FLAG_BINARY);
+    releaseLock();
+    return success;
+}
+
+uint32_t EEPROMFS::readRingFile(fileId_t fileId, uint8_t* readBuf, uint32_t bufLen)
+{
+    uint32_t capacity;
+    uint32_t state;
+    uint32_t head;
+    uint32_t used;
+    uint32_t position;
+    uint32_t len;
+
+    getReadLock();
+
+    if ( !validFileSystemTable )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseReadLock();
+        return 0;
+    }
+    if ( (numFiles <= fileId) || (NULL == readBuf) )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseReadLock();
+        return 0;
+    }
+    if ( !isActive(fileId) )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        releaseReadLock();
+        return 0;
+    }
+    if ( isQuarantined(fileId) )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
+        releaseReadLock();
+        return 0;
+    }
+    if ( 0 == (fileTable[fileId].flags & EEPROM_FILE_FLAG_RING) )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseReadLock();
+        return 0;
+    }
+
+    capacity = fileTable[fileId].size - EEPROM_RING_STATE_SIZE;
+    std::memcpy(&state, disk + fileTable[fileId].startAddress, sizeof(state));
+    head = state & ~EEPROM_RING_FULL;
+    used = (0 != (state & EEPROM_RING_FULL)) ? capacity : head;
+
+    // Skip the oldest bytes that do not fit, then copy in at most two pieces
+    len = std::min(bufLen, used);
+    position = (((0 != (state & EEPROM_RING_FULL)) ? head : 0) + (used - len)) % capacity;
+    for ( uint32_t copied = 0; copied < len; )
+    {
+        uint32_t chunk = std::min(len - copied, capacity - position);
+
+        std::memcpy(readBuf + copied, disk + fileTable[fileId].startAddress + EEPROM_RING_STATE_SIZE + position, chunk);
+        copied += chunk;
+        position = 0;
+    }
+    setReadStatus(EEPROMStatus::EEPROM_OK);
+
+    releaseReadLock();
+    return len;
+}
+
+uint32_t EEPROMFS::readFileAt(fileId_t fileId, uint32_t offset, uint8_t* readBuf, uint32_t bufLen)
+{
+    uint32_t len;
+
+    getReadLock();
+
+    if ( !validFileSystemTable )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseReadLock();
+        return 0;
+    }
+    if ( (numFiles <= fileId) || (NULL == readBuf) )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseReadLock();
+        return 0;
+    }
+    if ( !isActive(fileId) )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        releaseReadLock();
+        return 0;
+    }
+    if ( isQuarantined(fileId) )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
+        releaseReadLock();
+        return 0;
+    }
+    if ( offset > fileTable[fileId].size )
+    {
+        setReadStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseReadLock();
+        return 0;
+    }
+
+    len = std::min(bufLen, fileTable[fileId].size - offset);
+    std::memcpy(readBuf, disk + fileTable[fileId].startAddress + offset, len);
+    setReadStatus(EEPROMStatus::EEPROM_OK);
+
+    releaseReadLock();
+    return len;
+}
+
+bool EEPROMFS::writeFileAt(fileId_t fileId, uint32_t offset, uint8_t* writeBuf, uint32_t bufLen)
+{
+    uint32_t size;
+    bool success;
+
+    getLock();
+
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        releaseLock();
+        return false;
+    }
+    if ( !writeEnabled )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
+    }
+    if ( (numFiles <= fileId) || isReserved(fileId) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseLock();
+        return false;
+    }
+
+    // disable to protect against follow up write call
+    writeEnabled = false;
+
+    if ( !isActive(fileId) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        releaseLock();
+        return false;
+    }
+    // Patching part of a damaged file would not make the rest trustworthy
+    if ( isQuarantined(fileId) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
+        releaseLock();
+        return false;
+    }
+    size = fileTable[fileId].size;
+    // Ring files are only ever written through appendToFile()
+    if ( (0 != (fileTable[fileId].flags & EEPROM_FILE_FLAG_RING)) ||
+         (offset > size) || (bufLen > size - offset) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseLock();
+        return false;
+    }
+    if ( !checkText(writeBuf, bufLen, fileTable[fileId].flags) )
+    {
+        releaseLock();
+        return false;
+    }
+    // The rest of a text file already checks out, so the patch only has to fit in with its
+    //   neighbours: nothing but NULs after a NUL, no NUL in front of the text that follows
+    if ( (0 == (fileTable[fileId].flags & EEPROM_FILE_FLAG_BINARY)) && (0 != bufLen) )
+    {
+        if ( (0 != offset) && (0 == disk[fileTable[fileId].startAddress + offset - 1]) && (0 != writeBuf[0]) )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_UNEXPECTED_NULLS, 0);
+            releaseLock();
+            return false;
+        }
+        if ( (offset + bufLen < size) && (0 == writeBuf[bufLen - 1]) &&
+             (0 != disk[fileTable[fileId].startAddress + offset + bufLen]) )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_UNEXPECTED_NULLS, bufLen - 1);
+            releaseLock();
+            return false;
+        }
+    }
+
+    // Log-structured images never overwrite the committed version, the patched copy goes to the head
+    if ( 0 != (header.flags & EEPROM_FS_FLAG_LOG) )
+    {
+        if ( header.logHead + size > eepromSize )
+        {
+            compactLog(true);
+        }
+        if ( header.logHead + size <= eepromSize )
+        {
+            uint32_t startAddress = header.logHead;
+
+            // Everything at and above the head is free, so the copy never overlaps the original
+            std::memcpy(disk + startAddress, disk + fileTable[fileId].startAddress, size);
+            std::memcpy(disk + startAddress + offset, writeBuf, bufLen);
+            markDirty(startAddress, size);
+            header.logHead += size;
+            fileTable[fileId].startAddress = startAddress;
+            fileTable[fileId].crc = eepromCrc32(disk + startAddress, size);
+            updateHandle(fileId);
+
+            success = commitChanges(); // program only the modified spans of the disk image
+            releaseLock();
+            return success;
+        }
+        // No room for a second copy even after collecting garbage, patch in place below
+    }
+    // Packed images put the patched copy next to the file if a gap there is big enough
+    else
+    {
+        uint32_t oldStart = fileTable[fileId].startAddress;
+        uint32_t copyStart = findCopySpace(fileId, size);
+
+        if ( 0 != copyStart )
+        {
+            std::memcpy(disk + copyStart, disk + oldStart, size);
+            std::memcpy(disk + copyStart + offset, writeBuf, bufLen);
+            markDirty(copyStart, size);
+            fileTable[fileId].startAddress = copyStart;
+            fileTable[fileId].crc = eepromCrc32(disk + copyStart, size);
+            updateHandle(fileId);
+
+            success = commitThenErase(oldStart, size);
+            releaseLock();
+            return success;
+        }
+    }
+
+    // No room for a copy: only the bytes that actually change are programmed, plus the file's
+    //   checksum in the table. Like shifting files this is not safe against power loss.
+    stage(fileTable[fileId].startAddress + offset, writeBuf, bufLen);
+    fileTable[fileId].crc = eepromCrc32(disk + fileTable[fileId].startAddress, size);
+
+    success = commitChanges(); // program only the modified spans of the disk image
+    releaseLock();
+    return success;
+}
+
+bool EEPROMFS::deleteFile(fileId_t fileId)
+{
+    uint32_t oldStart;
+    uint32_t oldSize;
+    bool success;
+
+    getLock();
+
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        releaseLock();
+        return false;
+    }
+    if ( !writeEnabled )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
+    }
+    if ( (numFiles <= fileId) || isReserved(fileId) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseLock();
+        return false;
+    }
+
+    // disable to protect against follow up write call
+    writeEnabled = false;
+
+    // File does not exist
+    if ( !isActive(fileId) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        releaseLock();
+        return false;
+    }
+
+    // Verify the file was not disabled (zero length size)
+    if ( fileTable[fileId].size == 0 )
+    {
+        fileTable[fileId].startAddress = 0;
+        fileTable[fileId].crc = 0;
+        fileTable[fileId].flags = 0;
+        clearActive(fileId);
+        setQuarantined(fileId, false);
+        updateHandle(fileId);
+        success = commitChanges(); // program only the modified spans of the disk image
+        releaseLock();
+        return success;
+    }
+
+    // In a log-structured image the old data simply becomes garbage; dropping the table entry is enough
+    if ( 0 != (header.flags & EEPROM_FS_FLAG_LOG) )
+    {
+        bytesUsed -= fileTable[fileId].size;
+        fileTable[fileId].startAddress = 0;
+        fileTable[fileId].size = 0;
+        fileTable[fileId].crc = 0;
+        fileTable[fileId].flags = 0;
+        clearActive(fileId);
+        setQuarantined(fileId, false);
+        updateHandle(fileId);
+        success = commitChanges();
+        releaseLock();
+        return success;
+    }
+
+    // Reclaim size, the data itself is only nuked once the table without the file is committed
+    oldStart = fileTable[fileId].startAddress;
+    oldSize = fileTable[fileId].size;
+    bytesUsed -= oldSize;
+
+    // invalidate file table entry
+    fileTable[fileId].startAddress = 0;
+    fileTable[fileId].size = 0;
+    fileTable[fileId].crc = 0;
+    fileTable[fileId].flags = 0;
+    updateHandle(fileId);
+
+    // The files after it stay where they are, the gap is left for their neighbours to grow into
+    clearActive(fileId);
+    setQuarantined(fileId, false);
+    success = commitThenErase(oldStart, oldSize);
+    releaseLock();
+    return success;
+}
+
+bool EEPROMFS::writeNamedFile(const char* name, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags)
+{
+    uint32_t bound[(EEPROM_MAX_NUM_FILES + 31) / 32];
+    EEPROMTransaction transaction;
+    const dirEntry_t* directory;
+    uint32_t dirCount;
+    uint32_t entry;
+    fileId_t dirId;
+    fileId_t fileId;
+    bool success;
+
+    getLock();
+
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        releaseLock();
+        return false;
+    }
+    if ( !writeEnabled )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
+    }
+    if ( (0 == (header.flags & EEPROM_FS_FLAG_NAMES)) || (NULL == name) ||
+         (0 == nameLength(name)) || (EEPROM_MAX_NAME_LEN == nameLength(name)) ||
+         (0 != (fileFlags & ~EEPROM_FILE_FLAGS)) || (0 != (fileFlags & EEPROM_FILE_FLAG_RING)) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseLock();
+        return false;
+    }
+
+    // disable to protect against follow up write call
+    writeEnabled = false;
+
+    dirId = numFiles - 1;
+    // Rewriting a damaged directory would lose every name in it
+    if ( isQuarantined(dirId) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
+        releaseLock();
+        return false;
+    }
+    // A file can never be larger than the image (this also guards the sums below)
+    if ( bufLen > eepromSize )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+        releaseLock();
+        return false;
+    }
+    if ( !checkText(writeBuf, bufLen, fileFlags) )
+    {
+        releaseLock();
+        return false;
+    }
+
+    directory = (const dirEntry_t *)(disk + fileTable[dirId].startAddress);
+    dirCount = isActive(dirId) ? std::min(fileTable[dirId].size / static_cast<uint32_t>(sizeof(dirEntry_t)), static_cast<uint32_t>(dirId)) : 0;
+
+    // A known name is an ordinary write of the file it is bound to
+    entry = findName(name);
+    if ( EEPROM_NO_FILE != entry )
+    {
+        fileId = directory[entry].fileId;
+        if ( bytesUsed - (isActive(fileId) ? fileTable[fileId].size : 0) + bufLen > eepromSize )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+            releaseLock();
+            return false;
+        }
+        success = storeFile(fileId, writeBuf, bufLen, fileFlags);
+        releaseLock();
+        return success;
+    }
+
+    // A new name gets the lowest id that is neither in use nor bound to another name
+    std::memset(bound, 0, sizeof(bound));
+    for ( entry = 0; entry < dirCount; entry++ )
+    {
+        if ( directory[entry].fileId < dirId )
+        {
+            bound[directory[entry].fileId >> 5] |= 1u << (directory[entry].fileId & 0x1F);
+        }
+    }
+    for ( fileId = 0; fileId < dirId; fileId++ )
+    {
+        if ( !isActive(fileId) && (0 == (bound[fileId >> 5] & (1u << (fileId & 0x1F)))) )
+        {
+            break;
+        }
+    }
+    if ( (fileId == dirId) || (bytesUsed + bufLen + sizeof(dirEntry_t) > eepromSize) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+        releaseLock();
+        return false;
+    }
+
+    // The directory is rewritten with the new entry at the end, in the same update as the file
+    std::memcpy(newDirectory, directory, dirCount * sizeof(dirEntry_t));
+    std::memset(newDirectory[dirCount].name, 0, EEPROM_MAX_NAME_LEN);
+    std::strncpy(newDirectory[dirCount].name, name, EEPROM_MAX_NAME_LEN - 1);
+    newDirectory[dirCount].hash = eepromNameHash(name, EEPROM_MAX_NAME_LEN);
+    newDirectory[dirCount].fileId = fileId;
+
+    transaction.writeFile(fileId, writeBuf, bufLen, fileFlags);
+    transaction.writeFile(dirId, (uint8_t*)newDirectory, (dirCount + 1) * sizeof(dirEntry_t), EEPROM_FILE_FLAG_BINARY);
+    if ( 0 != (header.flags & EEPROM_FS_FLAG_LOG) )
+    {
+        success = commitLog(transaction);
+    }
+    else
+    {
+        success = commitPacked(transaction);
+    }
+    loadDirectory();
+
+    releaseLock();
+    return success;
+}
+
+bool EEPROMFS::deleteNamedFile(const char* name)
+{
+    EEPROMTransaction transaction;
+    const dirEntry_t* directory;
+    uint32_t dirCount;
+    uint32_t entry;
+    fileId_t dirId;
+    fileId_t fileId;
+    bool success;
+
+    getLock();
+
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        releaseLock();
+        return false;
+    }
+    if ( !writeEnabled )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
+    }
+    if ( (0 == (header.flags & EEPROM_FS_FLAG_NAMES)) || (NULL == name) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        releaseLock();
+        return false;
+    }
+
+    // disable to protect against follow up write call
+    writeEnabled = false;
+
+    dirId = numFiles - 1;
+    if ( isQuarantined(dirId) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
+        releaseLock();
+        return false;
+    }
+    entry = findName(name);
+    if ( EEPROM_NO_FILE == entry )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        releaseLock();
+        return false;
+    }
+
+    directory = (const dirEntry_t *)(disk + fileTable[dirId].startAddress);
+    dirCount = std::min(fileTable[dirId].size / static_cast<uint32_t>(sizeof(dirEntry_t)), static_cast<uint32_t>(dirId));
+    fileId = directory[entry].fileId;
+
+    // The file (if it still exists) and its directory entry go in the same update.
+    //   The last name takes the directory file with it.
+    if ( 1 < dirCount )
+    {
+        std::memcpy(newDirectory, directory, entry * sizeof(dirEntry_t));
+        std::memcpy(newDirectory + entry, directory + entry + 1, (dirCount - entry - 1) * sizeof(dirEntry_t));
+        transaction.writeFile(dirId, (uint8_t*)newDirectory, (dirCount - 1) * sizeof(dirEntry_t), EEPROM_FILE_FLAG_BINARY);
+    }
+    else
+    {
+        transaction.deleteFile(dirId);
+    }
+    if ( isActive(fileId) )
+    {
+        transaction.deleteFile(fileId);
+    }
+    if ( 0 != (header.flags & EEPROM_FS_FLAG_LOG) )
+    {
+        success = commitLog(transaction);
+    }
+    else
+    {
+        success = commitPacked(transaction);
+    }
+    loadDirectory();
+
+    releaseLock();
+    return success;
+}
+
+bool EEPROMFS::commit(EEPROMTransaction& transaction)
+{
+    uint64_t newBytesUsed;
+    bool success;
+
+    getLock();
+
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        releaseLock();
+        return false;
+    }
+    if ( !writeEnabled )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
+    }
+
+    // disable to protect against follow up write call
+    writeEnabled = false;
+
+    // Check every operation before anything is touched, so a bad one leaves the file system as it was
+    newBytesUsed = bytesUsed;
+    for ( uint32_t i = 0; i < transaction.operationCount; i++ )
+    {
+        const EEPROMTransaction::operation_t* op = &transaction.operations[i];
+
+        if ( (numFiles <= op->fileId) || isReserved(op->fileId) || (0 != (op->fileFlags & ~EEPROM_FILE_FLAGS)) ||
+             (0 != (op->fileFlags & EEPROM_FILE_FLAG_RING)) )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+            releaseLock();
+            return false;
+        }
+        if ( op->remove && !isActive(op->fileId) )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+            releaseLock();
+            return false;
+        }
+        if ( !op->remove && !checkText(op->writeBuf, op->bufLen, op->fileFlags) )
+        {
+            releaseLock();
+            return false;
+        }
+        if ( isActive(op->fileId) )
+        {
+            newBytesUsed -= fileTable[op->fileId].size;
+        }
+        if ( !op->remove )
+        {
+            newBytesUsed += op->bufLen;
+        }
+    }
+    if ( newBytesUsed > eepromSize )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+        releaseLock();
+        return false;
+    }
+
+    if ( 0 == transaction.operationCount )
+    {
+        success = true;
+    }
+    else if ( 0 != (header.flags & EEPROM_FS_FLAG_LOG) )
+    {
+        success = commitLog(transaction);
+    }
+    else
+    {
+        success = commitPacked(transaction);
+    }
+    if ( success )
+    {
+        transaction.clear();
+    }
+
+    releaseLock();
+    return success;
+}
+
+bool EEPROMFS::collectGarbage()
+{
+    bool success = true;
+
+    getLock();
+
+    if ( !validFileSystemTable )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+        releaseLock();
+        return false;
+    }
+    if ( !ready )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        releaseLock();
+        return false;
+    }
+    if ( !writeEnabled )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+        releaseLock();
+        return false;
+    }
+
+    // disable to protect against follow up write call
+    writeEnabled = false;
+
+    if ( 0 != (header.flags & EEPROM_FS_FLAG_LOG) )
+    {
+        uint32_t oldHead = header.logHead;
+
+        compactLog(true);
+        // The head only moves back if something was actually reclaimed
+        if ( header.logHead != oldHead )
+        {
+            success = commitChanges();
+        }
+    }
+
+    releaseLock();
+    return success;
+}
+
+bool EEPROMFS::format(fileId_t numFiles, uint8_t flags, uint8_t numSlots, uint16_t slack)
+{
+    bool success = false;
+
+    getLock();
+
+    if ( !hwInitialized )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+    }
+    else if ( !writeEnabled )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_PROTECTED);
+    }
+    else
+    {
+        writeEnabled = false;
+        if ( formatEEPROM(numFiles, flags, numSlots, slack) )
+        {
+            // re-verify the filesystem table
+            validFileSystemTable = validateFileSystem();
+            success = validFileSystemTable;
+        }
+    }
+
+    releaseLock();
+
+    return success;
+}
+
+/*****************************************************************************************************/
+/* Private                                                                                           */
+/*****************************************************************************************************/
+
+uint32_t EEPROMFS::read( uint8_t* buf, uint32_t startAddress, uint32_t len )
+{
+    uint32_t readLen;
+
+    if ( !hwInitialized )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        return 0;
+    }
+
+    // Check for correct word alignment prior to making API calls
+    // Must be a multiple of 4
+    if ( 0 != (startAddress & 0x03) || 0 != (len & 0x03) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WORD_ALIGNMENT);
+        return 0;
+    }
+
+    if ( startAddress + len > eepromSize )
+    {
+        readLen = eepromSize - startAddress;
+    }
+    else
+    {
+        readLen = len;
+    }
+
+    if ( ! backend->read(buf, startAddress, readLen) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_API);
+        return 0;
+    }
+
+    status.setStatus(EEPROMStatus::EEPROM_OK);
+    return readLen;
+}
+
+bool EEPROMFS::write( uint8_t* buf, uint32_t startAddress, uint32_t len )
+{
+
+    if ( !hwInitialized )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NOT_INITIALIZED);
+        return false;
+    }
+
+    // Check for correct word alignment prior to making API calls
+    // Must be a multiple of 4
+    if ( 0 != (startAddress & 0x03) || 0 != (len & 0x03) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WORD_ALIGNMENT);
+        return 0;
+    }
+
+    if ( startAddress + len > eepromSize )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+        return false;
+    }
+
+    if ( ! backend->program(buf, startAddress, len) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_ERROR);
+        return false;
+    }
+#if defined(EEPROM_FS_WEAR)
+    countWear(startAddress, len);
+#endif
+
+    status.setStatus(EEPROMStatus::EEPROM_OK);
+    return true;
+}
+
+bool EEPROMFS::init()
+{
+    bool success;
+
+    if ( backend->init() )
+    {
+        hwInitialized = true;
+        // Use the whole medium unless the caller asked for a specific image size
+        if ( 0 == eepromSize )
+        {
+            eepromSize = backend->size();
+        }
+
+        if ( (eepromSize <= sizeof(fsHeader_t)) || (eepromSize > backend->size()) )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+            success = false;
+        }
+        // Image must be whole words and addressable by the on-media address format
+        else if ( (0 != (eepromSize & 0x03)) || (eepromSize > EEPROM_MAX_IMAGE_SIZE) )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+            success = false;
+        }
+        else
+        {
+            // Allocate a word-aligned block of memory to use as a disk image
+            // Since we're using uint32_t to accomplish this, we only need 1/4 as many units of memory
+            wordAlignedDisk = new (std::nothrow) uint32_t[(eepromSize>>2)];
+            // copy the address of the allocated space to our uint8_t* pointer
+            disk = (uint8_t*)wordAlignedDisk;
+#if defined(EEPROM_FS_WEAR)
+            wearBlocks = (eepromSize + EEPROM_WEAR_BLOCK_SIZE - 1) / EEPROM_WEAR_BLOCK_SIZE;
+            wearCounters = new (std::nothrow) uint32_t[wearBlocks]();
+            wearImage = new (std::nothrow) uint32_t[2 + wearBlocks];
+            if ( (NULL == wearCounters) || (NULL == wearImage) )
+            {
+                disk = NULL;
+            }
+#endif
+#if defined(EEPROM_FS_SNAPSHOTS)
+            // The whole pool up front, so updates never allocate
+            for ( uint32_t i = 0; i < EEPROM_SNAPSHOT_POOL_SIZE; i++ )
+            {
+                snapshots[i] = new (std::nothrow) EEPROMSnapshot(eepromSize);
+                if ( (NULL == snapshots[i]) || (NULL == snapshots[i]->image) )
+                {
+                    disk = NULL;
+                }
+            }
+#endif
+            if ( NULL == disk )
+            {
+                status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_MEMORY);
+                success = false;
+            }
+            else
+            {
+                validFileSystemTable = validateFileSystem(); // this also sets the status
+                success = true; // we return true even if the filesystem has no valid table - that's reflected in the status message
+            }
+        }
+    }
+    else
+    {
+        status.setStatus(EEPROMStatus:: EEPROM_ERROR_API);
+        success = false;
+    }
+
+    return success;
+}
+
+bool EEPROMFS::validateFileSystem()
+{
+    uint32_t i;
+
+    // initially, assume we're going to fail, update with specific failure types if we can
+    status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+    validFileSystemTable = false;
+    statsAdd(mounts, 1);
+#if defined(EEPROM_FS_SNAPSHOTS)
+    publishSnapshot();
+#endif
+
+    // reset properties
+    numFiles = 0;
+    resetActiveFiles();
+    std::memset(quarantineBitmap, 0, sizeof(quarantineBitmap));
+    quarantinedFileCount = 0;
+    std::memset(nameIndex, 0xFF, sizeof(nameIndex));
+    firstFileAddr = 0;
+    bytesUsed = 0;
+
+    // read our entire "disk" into memory
+    if ( eepromSize != read(disk, EEPROM_HEADER_ADDR, eepromSize) )
+    {
+        return false;
+    }
+
+    status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+
+    // The header of the first slot tells us the geometry shared by all slots.
+    //   Verify it describes an image this build can use, and that the slots fit
+    const fsHeader_t* first = (const fsHeader_t *)(disk + EEPROM_HEADER_ADDR);
+    if ( (EEPROM_FS_MAGIC != first->magic) ||
+         (EEPROM_FS_VERSION != first->version) ||
+         (sizeof(eepromAddr_t) != first->addressWidth) ||
+         (0 == first->numFiles) ||
+         (EEPROM_MAX_NUM_FILES < first->numFiles) ||
+         (0 == first->numSlots) ||
+         (EEPROM_MAX_TABLE_SLOTS < first->numSlots) ||
+         (0 != (first->flags & ~EEPROM_FS_FLAGS)) )
+    {
+        return false;
+    }
+    slotSize = (EEPROM_FTABLE_OFFSET + (first->numFiles * sizeof(fileEntry_t)) + 3) & ~0x03u;
+    if ( first->numSlots * slotSize >= eepromSize )
+    {
+        return false;
+    }
+
+    // The newest slot carrying the same geometry and a matching checksum holds the current table.
+    //   Slots whose update never completed fail the checksum and are skipped.
+    const fsHeader_t* newest = NULL;
+    for ( i = 0; i < first->numSlots; i++ )
+    {
+        const fsHeader_t* candidate = (const fsHeader_t *)(disk + EEPROM_HEADER_ADDR + (i * slotSize));
+
+        if ( (first->magic == candidate->magic) &&
+             (first->version == candidate->version) &&
+             (first->addressWidth == candidate->addressWidth) &&
+             (first->numFiles == candidate->numFiles) &&
+             (first->numSlots == candidate->numSlots) &&
+             (first->flags == candidate->flags) &&
+             (candidate->tableCrc == tableChecksum(candidate, (const fileEntry_t *)((const uint8_t *)candidate + EEPROM_FTABLE_OFFSET))) &&
+             ((NULL == newest) || sequenceNewer(candidate->sequence, newest->sequence)) )
+        {
+            newest = candidate;
+            currentSlot = i;
+        }
+    }
+    if ( NULL == newest )
+    {
+        return false;
+    }
+    std::memcpy(&header, disk + EEPROM_HEADER_ADDR + (currentSlot * slotSize), sizeof(fsHeader_t));
+    std::memcpy(fileTable, disk + EEPROM_HEADER_ADDR + (currentSlot * slotSize) + EEPROM_FTABLE_OFFSET,
+                header.numFiles * sizeof(fileEntry_t));
+
+    numFiles = header.numFiles;
+    firstFileAddr = EEPROM_HEADER_ADDR + (header.numSlots * slotSize);
+    bytesUsed = firstFileAddr; // at a minimum, we're using a portion for the header and file system table
+
+    bool logStructured = (0 != (header.flags & EEPROM_FS_FLAG_LOG));
+    // Files of a log-structured image all live below the log head
+    uint32_t dataEnd = logStructured ? header.logHead : eepromSize;
+    if ( (dataEnd < firstFileAddr) || (dataEnd > eepromSize) )
+    {
+        bytesUsed = 0; // we've failed
+        return false;
+    }
+
+    uint32_t lastEndPoint = firstFileAddr; // the very first occurs at start of file data section
+
+    // Verify the table is reasonable
+    for ( i = 0; i < numFiles; i++ )
+    {
+        // Check for a disabled entry (zeroed out startAddress), verify size is also disabled
+        if ( fileTable[i].startAddress == 0 && fileTable[i].size != 0 )
+        {
+            bytesUsed = 0; // we've failed
+            return false;
+        }
+        // If the entry is purely disabled, skip and go to next entry
+        else if ( fileTable[i].startAddress == 0 && fileTable[i].size == 0 )
+        {
+            continue;
+        }
+        // If it's enabled, verify it comes after end of last file (packed images keep files
+        //   in fileId order, log-structured ones are checked for overlaps once sorted below)
+        else if ( fileTable[i].startAddress < lastEndPoint )
+        {
+            bytesUsed = 0; // we've failed
+            return false;
+        }
+        // If the file's address is good, verify length is reasonable given size and place in EEPROM
+        else if ( (static_cast<uint32_t>(fileTable[i].startAddress) + fileTable[i].size) > dataEnd )
+        {
+            bytesUsed = 0; // we've failed
+            return false;
+        }
+
+        setActive(i);
+        if ( !logStructured )
+        {
+            lastEndPoint = fileTable[i].startAddress + fileTable[i].size; // update pointer to end of this file
+        }
+        bytesUsed += fileTable[i].size; // add file usage to total amount tracked
+    }
+
+    // Log-structured files may sit in any order, but must not overlap
+    if ( logStructured )
+    {
+        uint32_t count = sortFilesByAddress();
+
+        for ( i = 1; i < count; i++ )
+        {
+            const fileEntry_t* prev = &fileTable[addressOrder[i - 1]];
+            if ( static_cast<uint32_t>(prev->startAddress) + prev->size > fileTable[addressOrder[i]].startAddress )
+            {
+                resetActiveFiles();
+                bytesUsed = 0; // we've failed
+                return false;
+            }
+        }
+    }
+
+    // Verify every file on its own. A damaged file is quarantined, the rest stay usable
+    for ( fileId_t file = firstActiveFile(); file != EEPROM_NO_FILE; file = nextActiveFile(file) )
+    {
+        if ( !verifyFile(file) )
+        {
+            setQuarantined(file, true);
+        }
+    }
+
+    // Names resolve through a hash index built once here, never by scanning the directory
+    loadDirectory();
+
+    // set the status and validFileSystemTable flags indicating everything is good!
+    status.setStatus(EEPROMStatus::EEPROM_OK);
+    validFileSystemTable = true;
+#if defined(EEPROM_FS_SNAPSHOTS)
+    publishSnapshot();
+#endif
+
+    return validFileSystemTable;
+}
+
+bool EEPROMFS::formatEEPROM(fileId_t numFiles, uint8_t flags, uint8_t numSlots, uint16_t slack)
+{
+    uint32_t slot;
+    bool writeStatus;
+
+    if ( 0 == numSlots )
+    {
+        numSlots = (0 != (flags & EEPROM_FS_FLAG_LOG)) ? EEPROM_LOG_TABLE_SLOTS : EEPROM_PACKED_TABLE_SLOTS;
+    }
+    slot = (EEPROM_FTABLE_OFFSET + (numFiles * sizeof(fileEntry_t)) + 3) & ~0x03u;
+
+    // make sure the table slots leave room for file data
+    if ( (0 == numFiles) || (EEPROM_MAX_NUM_FILES < numFiles) ||
+         (EEPROM_MAX_TABLE_SLOTS < numSlots) ||
+         (0 != (flags & ~EEPROM_FS_FLAGS)) ||
+         ((0 != (flags & EEPROM_FS_FLAG_NAMES)) && (2 > numFiles)) ||
+         (EEPROM_HEADER_ADDR + (numSlots * slot) >= eepromSize) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_BAD_PARAMS);
+        return false;
+    }
+
+    // nuke entire EEPROM - set to FF's
+    if ( ! backend->massErase() )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_API);
+        return false;
+    }
+
+    // the EEPROM no longer holds anything we were waiting to program
+    dirtyCount = 0;
+#if defined(EEPROM_FS_WEAR)
+    countWear(0, wearBlocks * EEPROM_WEAR_BLOCK_SIZE);
+#endif
+
+    this->numFiles = numFiles;
+    slotSize = slot;
+    firstFileAddr = EEPROM_HEADER_ADDR + (numSlots * slotSize);
+    bytesUsed = firstFileAddr;
+
+    // the image is erased, so is our copy of it
+    std::memset(disk, 0xFF, eepromSize);
+
+    header.magic = EEPROM_FS_MAGIC;
+    header.version = EEPROM_FS_VERSION;
+    header.addressWidth = sizeof(eepromAddr_t);
+    header.numFiles = numFiles;
+    header.numSlots = numSlots;
+    header.flags = flags;
+    header.slack = slack;
+    header.sequence = 0;
+    header.logHead = firstFileAddr;
+
+    // init file system table to zeros (all disabled)
+    std::memset(fileTable, 0, numFiles * sizeof(fileEntry_t));
+
+    // The first commit lands in slot 0, the remaining slots stay erased until the table rotates into them
+    //   Call to write() will set the EEPROM status property
+    currentSlot = numSlots - 1;
+    writeStatus = commitTable();
+
+    if ( !writeStatus )
+    {
+        bytesUsed = 0;
+    }
+
+    return writeStatus;
+}
+
+handle_t* EEPROMFS::openFile(fileId_t index)
+{
+    manager_t* manager;
+
+    // Verify that the file has exists
+    if ( !isActive(index) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_FILE_NOT_FOUND);
+        return NULL;
+    }
+
+    // Quarantined files have no trustworthy content to hand out
+    if ( isQuarantined(index) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE);
+        return NULL;
+    }
+
+    // Every file has a preallocated manager slot, so opening never allocates
+    manager = &handleManager[index];
+    statsAdd(opens, 1);
+
+    // increment the reference count to the handle
+    manager->handleCount += 1;
+
+    // First customer! Populate handle with file info
+    if ( 1 == manager->handleCount )
+    {
+        statsAdd(handleFills, 1);
+        if ( ! updateHandle(index) )
+        {
+            manager->handleCount = 0;
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
+            return NULL;
+        }
+    }
+
+    // return the handle to the calling task
+    return &manager->handle;
+}
+
+bool EEPROMFS::updateHandle(fileId_t index)
+{
+    // Nobody holds a handle to this file, nothing to update
+    if ( 0 == handleManager[index].handleCount )
+    {
+        return false;
+    }
+
+    handleManager[index].handle.size = fileTable[index].size;
+    handleManager[index].handle.data = disk + fileTable[index].startAddress;
+    handleManager[index].handle.flags = fileTable[index].flags;
+
+    return true;
+}
+
+bool EEPROMFS::shiftFileData(uint32_t startAddress, uint32_t endAddress, int32_t distance)
+{
+    uint32_t len;
+
+    // Sanity checks
+    // Is the block within the range covered by "disk" buffer?
+    if ( (startAddress > endAddress) || (endAddress > eepromSize) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
+        return false;
+    }
+    len = endAddress - startAddress;
+    statsAdd(bytesMoved, len);
+
+    // Move to the "right"
+    if ( (distance > 0) && (distance < static_cast<int32_t>(eepromSize)) )
+    {
+        // make sure the move will not fall off the end of the buffer
+        if ( endAddress + distance > eepromSize )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
+            return false;
+        }
+
+        std::memmove(disk + startAddress + distance, disk + startAddress, len);
+        // Invalidate where our old data used to be - don't want remnants of data hanging around
+        std::memset(disk + startAddress, 0xFF, std::min(static_cast<uint32_t>(distance), len));
+        // Both the old location (now 0xFF) and the new location need to be programmed
+        markDirty(startAddress, len + distance);
+    }
+    // Move to the "left"
+    else if ( (distance < 0) && (distance > (-1 * static_cast<int32_t>(eepromSize))) )
+    {
+        // make sure the move will not moves past the beginning of the buffer
+        if ( startAddress < static_cast<uint32_t>(-distance) ) // distance is negative
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
+            return false;
+        }
+
+        std::memmove(disk + startAddress + distance, disk + startAddress, len);
+        // Invalidate the tail we moved away from
+        std::memset(disk + endAddress - std::min(static_cast<uint32_t>(-distance), len), 0xFF,
+                    std::min(static_cast<uint32_t>(-distance), len));
+        markDirty(startAddress + distance, len - distance);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool EEPROMFS::relocateFiles(fileId_t first, fileId_t last, int32_t distance)
+{
+    // Files are kept in fileId order, so everything from first to last is one
+    // block that can be moved with a single copy
+    if ( ! shiftFileData(fileTable[first].startAddress,
+                         fileTable[last].startAddress + fileTable[last].size, distance) )
+    {
+        return false;
+    }
+
+    for ( fileId_t id = first; id != nextActiveFile(last); id = nextActiveFile(id) )
+    {
+        fileTable[id].startAddress += distance; // adjust starting position
+        updateHandle(id); // update any handles that have this affected file
+    }
+
+    return true;
+}
+
+bool EEPROMFS::placeFile(fileId_t fileId, uint32_t size)
+{
+    fileId_t prevFile = prevActiveFile(fileId);
+    fileId_t nextFile = nextActiveFile(fileId);
+    uint32_t start;
+    uint32_t limit;
+
+    // An existing file keeps its start, a new one goes directly behind the file before it
+    if ( isActive(fileId) )
+    {
+        start = fileTable[fileId].startAddress;
+    }
+    else if ( EEPROM_NO_FILE == prevFile )
+    {
+        start = firstFileAddr;
+    }
+    else
+    {
+        start = fileTable[prevFile].startAddress + fileTable[prevFile].size;
+    }
+    limit = (EEPROM_NO_FILE == nextFile) ? eepromSize : fileTable[nextFile].startAddress;
+
+    if ( limit - start < size )
+    {
+        if ( (EEPROM_NO_FILE == nextFile) || !makeRoom(nextFile, size - (limit - start)) )
+        {
+            return false;
+        }
+    }
+    // A new file leaves the file before it its headroom if the gap allows
+    else if ( !isActive(fileId) && (EEPROM_NO_FILE != prevFile) )
+    {
+        start += std::min(static_cast<uint32_t>(header.slack), limit - start - size);
+    }
+
+    fileTable[fileId].startAddress = start;
+    return true;
+}
+
+bool EEPROMFS::makeRoom(fileId_t first, uint32_t need)
+{
+    for ( fileId_t last = first; last != EEPROM_NO_FILE; last = nextActiveFile(last) )
+    {
+        fileId_t nextFile = nextActiveFile(last);
+        uint32_t end = fileTable[last].startAddress + fileTable[last].size;
+        uint32_t gap = ((EEPROM_NO_FILE == nextFile) ? eepromSize : fileTable[nextFile].startAddress) - end;
+
+        if ( gap >= need )
+        {
+            return relocateFiles(first, last, std::min(need + header.slack, gap));
+        }
+    }
+    return false;
+}
+
+void EEPROMFS::packFiles(uint32_t reserve)
+{
+    fileId_t last = lastActiveFile();
+    uint32_t oldEnd;
+    uint32_t spare;
+    uint32_t headroom = 0;
+    uint32_t cursor = firstFileAddr;
+
+    if ( EEPROM_NO_FILE == last )
+    {
+        return;
+    }
+    oldEnd = fileTable[last].startAddress + fileTable[last].size;
+    statsAdd(repacks, 1);
+
+    // Share whatever is left after the reserve evenly, up to the image's slack per file
+    spare = eepromSize - bytesUsed;
+    if ( spare > reserve )
+    {
+        headroom = std::min(static_cast<uint32_t>(header.slack), (spare - reserve) / activeFileCount);
+    }
+
+    for ( fileId_t id = firstActiveFile(); id != EEPROM_NO_FILE; id = nextActiveFile(id) )
+    {
+        fileTarget[id] = cursor;
+        cursor += fileTable[id].size + headroom;
+    }
+    moveFiles();
+    eraseGaps(firstFileAddr, std::max(oldEnd, cursor - headroom));
+}
+
+void EEPROMFS::moveFiles()
+{
+    fileId_t id;
+
+    for ( id = firstActiveFile(); id != EEPROM_NO_FILE; id = nextActiveFile(id) )
+    {
+        if ( fileTarget[id] < fileTable[id].startAddress )
+        {
+            std::memmove(disk + fileTarget[id], disk + fileTable[id].startAddress, fileTable[id].size);
+            statsAdd(bytesMoved, fileTable[id].size);
+            fileTable[id].startAddress = fileTarget[id];
+            updateHandle(id);
+        }
+    }
+    for ( id = lastActiveFile(); id != EEPROM_NO_FILE; id = prevActiveFile(id) )
+    {
+        if ( fileTarget[id] > fileTable[id].startAddress )
+        {
+            std::memmove(disk + fileTarget[id], disk + fileTable[id].startAddress, fileTable[id].size);
+            statsAdd(bytesMoved, fileTable[id].size);
+            fileTable[id].startAddress = fileTarget[id];
+            updateHandle(id);
+        }
+    }
+}
+
+void EEPROMFS::eraseGaps(uint32_t startAddress, uint32_t endAddress)
+{
+    uint32_t cursor = startAddress;
+
+    for ( fileId_t id = firstActiveFile(); id != EEPROM_NO_FILE; id = nextActiveFile(id) )
+    {
+        uint32_t fileStart = fileTable[id].startAddress;
+        uint32_t fileEnd = fileStart + fileTable[id].size;
+
+        if ( fileStart >= endAddress )
+        {
+            break;
+        }
+        if ( fileStart > cursor )
+        {
+            std::memset(disk + cursor, 0xFF, fileStart - cursor);
+        }
+        cursor = std::max(cursor, fileEnd);
+    }
+    if ( cursor < endAddress )
+    {
+        std::memset(disk + cursor, 0xFF, endAddress - cursor);
+    }
+    markDirty(startAddress, endAddress - startAddress);
+}
+
+uint32_t EEPROMFS::findCopySpace(fileId_t fileId, uint32_t size)
+{
+    fileId_t prevFile = prevActiveFile(fileId);
+    fileId_t nextFile = nextActiveFile(fileId);
+    uint32_t start = fileTable[fileId].startAddress;
+    uint32_t end = start + fileTable[fileId].size;
+    uint32_t low = (EEPROM_NO_FILE == prevFile) ? firstFileAddr : fileTable[prevFile].startAddress + fileTable[prevFile].size;
+    uint32_t high = (EEPROM_NO_FILE == nextFile) ? eepromSize : fileTable[nextFile].startAddress;
+
+    // In front of the old copy, leaving the file before it its headroom if the gap allows
+    if ( start - low >= size )
+    {
+        return low + std::min(static_cast<uint32_t>(header.slack), start - low - size);
+    }
+    // Behind it (for the last file that is the free space at the end of the image)
+    if ( high - end >= size )
+    {
+        return end;
+    }
+    return 0;
+}
+
+bool EEPROMFS::commitThenErase(uint32_t oldStart, uint32_t oldSize)
+{
+    if ( !commitChanges() )
+    {
+        return false;
+    }
+    // In write-back mode the table in the EEPROM still points at the old copy until the next sync
+    if ( syncPending )
+    {
+        return true;
+    }
+    // Don't leave remnants of the old data, nothing refers to it any more
+    std::memset(disk + oldStart, 0xFF, oldSize);
+    markDirty(oldStart, oldSize);
+    return flush();
+}
+
+bool EEPROMFS::appendFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags)
+{
+    uint32_t startAddress;
+
+    // Not enough room left at the head, reclaim the garbage below it first
+    if ( header.logHead + bufLen > eepromSize )
+    {
+        compactLog(true);
+    }
+
+    // Still no room: the only way left is to drop the current version of this file and
+    // slide everything else over it. Unlike every other path this one is not safe
+    // against power loss, the file being replaced can be lost.
+    if ( header.logHead + bufLen > eepromSize )
+    {
+        if ( isActive(fileId) )
+        {
+            bytesUsed -= fileTable[fileId].size;
+            fileTable[fileId].startAddress = 0;
+            fileTable[fileId].size = 0;
+            fileTable[fileId].crc = 0;
+            fileTable[fileId].flags = 0;
+            clearActive(fileId);
+        }
+        compactLog(false);
+
+        // writeFile() already checked the file fits in the free space
+        if ( header.logHead + bufLen > eepromSize )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
+            return false;
+        }
+    }
+
+    if ( isActive(fileId) )
+    {
+        bytesUsed -= fileTable[fileId].size;
+    }
+
+    // Everything at and above the head is free, so the old version stays intact until
+    // the table pointing at the new one has been committed
+    startAddress = header.logHead;
+    if ( NULL == writeBuf )
+    {
+        std::memset(&disk[startAddress], 0, bufLen);
+    }
+    else
+    {
+        std::memcpy(&disk[startAddress], writeBuf, bufLen);
+    }
+    markDirty(startAddress, bufLen);
+    header.logHead += bufLen;
+
+    fileTable[fileId].startAddress = startAddress;
+    fileTable[fileId].size = bufLen;
+    fileTable[fileId].flags = fileFlags;
+    fileTable[fileId].crc = fileChecksum(fileId);
+    setActive(fileId);
+    setQuarantined(fileId, false);
+    bytesUsed += bufLen;
+    updateHandle(fileId);
+
+    return commitChanges(); // program only the modified spans of the disk image
+}
+
+bool EEPROMFS::storeFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags)
+{
+    uint32_t oldSize = isActive(fileId) ? fileTable[fileId].size : 0;
+    uint32_t oldStart = fileTable[fileId].startAddress;
+    uint32_t copyStart;
+
+    // Log-structured images never move other files to make room, the new version goes to the log head
+    if ( 0 != (header.flags & EEPROM_FS_FLAG_LOG) )
+    {
+        return appendFile(fileId, writeBuf, bufLen, fileFlags);
+    }
+
+    // The new version goes next to the committed one if a gap there is big enough, the old
+    //   copy is only erased once the table pointing at the new one has been committed
+    copyStart = isActive(fileId) ? findCopySpace(fileId, bufLen) : 0;
+    if ( 0 != copyStart )
+    {
+        fileTable[fileId].startAddress = copyStart;
+    }
+    else
+    {
+        // Last resort, not safe against power loss: nuke the original to prevent trailing characters
+        if ( isActive(fileId) )
+        {
+            std::memset(&disk[fileTable[fileId].startAddress], 0xFF, fileTable[fileId].size);
+            markDirty(fileTable[fileId].startAddress, fileTable[fileId].size);
+        }
+
+        // Grow into the gap behind the file if possible, otherwise shift the files after it.
+        //   Only when the free space is too scattered for either is everything laid out again.
+        if ( !placeFile(fileId, bufLen) )
+        {
+            packFiles((bufLen > oldSize) ? bufLen - oldSize : 0);
+            if ( !placeFile(fileId, bufLen) )
+            {
+                status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
+                return false;
+            }
+        }
+    }
+
+    // Write out file data to file table and disk
+    if ( NULL == writeBuf )
+    {
+        std::memset(&disk[fileTable[fileId].startAddress], 0, bufLen);
+    }
+    else
+    {
+        std::memcpy(&disk[fileTable[fileId].startAddress], writeBuf, bufLen);
+    }
+    markDirty(fileTable[fileId].startAddress, bufLen);
+    fileTable[fileId].size = bufLen;
+    fileTable[fileId].flags = fileFlags;
+    fileTable[fileId].crc = fileChecksum(fileId);
+    setActive(fileId);
+    setQuarantined(fileId, false);
+    updateHandle(fileId);
+    bytesUsed = bytesUsed - oldSize + bufLen; // adjust the total bytesUsed tracker
+
+    if ( 0 != copyStart )
+    {
+        return commitThenErase(oldStart, oldSize);
+    }
+    return commitChanges(); // program only the modified spans of the disk image
+}
+
+bool EEPROMFS::extendFile(fileId_t fileId, uint32_t offset, uint8_t* writeBuf, uint32_t bufLen)
+{
+    uint32_t size = fileTable[fileId].size;
+    uint32_t newSize = std::max(size, offset + bufLen);
+    uint32_t growth = newSize - size;
+    uint32_t oldStart = fileTable[fileId].startAddress;
+    uint32_t copyStart = 0;
+
+    if ( 0 != (header.flags & EEPROM_FS_FLAG_LOG) )
+    {
+        // The longer version goes to the head like any other new version, the old one stays
+        //   intact until the table pointing at the new one has been committed
+        if ( header.logHead + newSize > eepromSize )
+        {
+            compactLog(true);
+        }
+        if ( header.logHead + newSize <= eepromSize )
+        {
+            std::memcpy(disk + header.logHead, disk + fileTable[fileId].startAddress, size);
+            markDirty(header.logHead, size);
+            fileTable[fileId].startAddress = header.logHead;
+            header.logHead += newSize;
+        }
+        // No room for a copy: slide everything together and rotate the file to the end of the
+        //   data, where it can grow in place. Like the other last resorts this is not safe
+        //   against power loss.
+        else
+        {
+            uint32_t startAddress;
+
+            compactLog(false);
+            startAddress = fileTable[fileId].startAddress;
+            std::rotate(disk + startAddress, disk + startAddress + size, disk + header.logHead);
+            statsAdd(bytesMoved, header.logHead - startAddress);
+            markDirty(startAddress, header.logHead - startAddress);
+            for ( fileId_t id = firstActiveFile(); id != EEPROM_NO_FILE; id = nextActiveFile(id) )
+            {
+                if ( fileTable[id].startAddress > startAddress )
+                {
+                    fileTable[id].startAddress -= size;
+                    updateHandle(id);
+                }
+            }
+            fileTable[fileId].startAddress = header.logHead - size;
+            header.logHead += growth;
+        }
+    }
+    // Writing over the NUL padding of a packed file changes committed bytes, so that goes to
+    //   a fresh copy next to the file if there is room for one
+    else if ( (offset < size) && (0 != (copyStart = findCopySpace(fileId, newSize))) )
+    {
+        std::memcpy(disk + copyStart, disk + oldStart, size);
+        markDirty(copyStart, size);
+        fileTable[fileId].startAddress = copyStart;
+    }
+    // Packed images grow the file into the gap behind it, shifting the files after it if needed
+    else if ( !placeFile(fileId, newSize) )
+    {
+        packFiles(growth);
+        if ( !placeFile(fileId, newSize) )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
+            return false;
+        }
+    }
+
+    std::memcpy(disk + fileTable[fileId].startAddress + offset, writeBuf, bufLen);
+    markDirty(fileTable[fileId].startAddress + offset, bufLen);
+    fileTable[fileId].size = newSize;
+    // A plain append extends the checksum, anything written over the padding means starting over
+    if ( offset == size )
+    {
+        fileTable[fileId].crc = eepromCrc32(writeBuf, bufLen, fileTable[fileId].crc);
+    }
+    else
+    {
+        fileTable[fileId].crc = eepromCrc32(disk + fileTable[fileId].startAddress, newSize);
+    }
+    bytesUsed += growth;
+    updateHandle(fileId);
+
+    if ( 0 != copyStart )
+    {
+        return commitThenErase(oldStart, size);
+    }
+    return commitChanges(); // program only the modified spans of the disk image
+}
+
+bool EEPROMFS::appendRing(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen)
+{
+    uint32_t stateAddress = fileTable[fileId].startAddress;
+    uint32_t capacity = fileTable[fileId].size - EEPROM_RING_STATE_SIZE;
+    uint32_t state;
+    uint32_t head;
+
+    // Ring appends are programmed right away. Whatever write-back mode held back goes first,
+    //   otherwise the flushes below would program file data ahead of the table referring to it.
+    if ( syncPending && !commitTable() )
+    {
+        return false;
+    }
+
+    std::memcpy(&state, disk + stateAddress, sizeof(state));
+    head = state & ~EEPROM_RING_FULL;
+
+    // Only the newest capacity bytes can survive anyway
+    if ( bufLen > capacity )
+    {
+        writeBuf += bufLen - capacity;
+        bufLen = capacity;
+    }
+    while ( 0 < bufLen )
+    {
+        uint32_t chunk = std::min(bufLen, capacity - head);
+
+        std::memcpy(disk + stateAddress + EEPROM_RING_STATE_SIZE + head, writeBuf, chunk);
+        markDirty(stateAddress + EEPROM_RING_STATE_SIZE + head, chunk);
+        writeBuf += chunk;
+        bufLen -= chunk;
+        head += chunk;
+        if ( head == capacity )
+        {
+            head = 0;
+            state |= EEPROM_RING_FULL;
+        }
+    }
+
+    // The data has to be in place before the state word that makes it part of the ring.
+    //   The table does not change, ring files carry no checksum.
+    if ( !flush() )
+    {
+        return false;
+    }
+    state = (state & EEPROM_RING_FULL) | head;
+    stage(stateAddress, &state, sizeof(state));
+    if ( !flush() )
+    {
+        return false;
+    }
+#if defined(EEPROM_FS_SNAPSHOTS)
+    publishSnapshot();
+#endif
+
+    return true;
+}
+
+void EEPROMFS::compactLog(bool safeOnly)
+{
+    uint32_t count;
+    uint32_t cursor = firstFileAddr;
+
+    // Updates held back in write-back mode are garbage to the RAM table but may still be what
+    //   the committed table points at, so commit them before moving anything over them
+    if ( safeOnly && syncPending && !commitTable() )
+    {
+        return;
+    }
+    count = sortFilesByAddress();
+
+    statsAdd(compactions, 1);
+
+    // Moving in address order only ever copies data towards the start, so a file can
+    // never land on one that has not been moved yet
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        fileEntry_t* entry = &fileTable[addressOrder[i]];
+
+        if ( entry->startAddress != cursor )
+        {
+            if ( safeOnly )
+            {
+                // The committed table still points at the old copy, it has to survive the move
+                if ( entry->startAddress - cursor < entry->size )
+                {
+                    cursor = entry->startAddress + entry->size;
+                    continue;
+                }
+                std::memcpy(disk + cursor, disk + entry->startAddress, entry->size);
+            }
+            else
+            {
+                std::memmove(disk + cursor, disk + entry->startAddress, entry->size);
+            }
+            markDirty(cursor, entry->size);
+            statsAdd(bytesMoved, entry->size);
+            entry->startAddress = cursor;
+            updateHandle(addressOrder[i]);
+
+            // Commit right away: the space this file left behind may be the destination of the next move
+            if ( safeOnly && !commitTable() )
+            {
+                return;
+            }
+        }
+        cursor += entry->size;
+    }
+
+    header.logHead = cursor;
+}
+
+bool EEPROMFS::commitPacked(EEPROMTransaction& transaction)
+{
+    const EEPROMTransaction::operation_t* op;
+    fileId_t first = EEPROM_NO_FILE;
+    fileId_t prevFile;
+    fileId_t last = lastActiveFile();
+    uint32_t oldEnd;
+    uint32_t tailStart;
+    uint32_t tailBytes;
+    uint32_t tailCount;
+    uint32_t headroom = 0;
+    uint32_t cursor;
+    uint32_t id;
+
+    oldEnd = (EEPROM_NO_FILE == last) ? firstFileAddr : fileTable[last].startAddress + fileTable[last].size;
+
+    // Everything in front of the first file the transaction touches stays where it is,
+    //   the files from there on are laid out again with their final sizes
+    for ( uint32_t i = 0; i < transaction.operationCount; i++ )
+    {
+        first = std::min(first, transaction.operations[i].fileId);
+    }
+    prevFile = prevActiveFile(first);
+    tailStart = (EEPROM_NO_FILE == prevFile) ? firstFileAddr : fileTable[prevFile].startAddress + fileTable[prevFile].size;
+    for ( ;; )
+    {
+        tailBytes = 0;
+        tailCount = 0;
+        for ( id = first; id < numFiles; id++ )
+        {
+            op = transaction.find(id);
+            if ( (NULL != op) ? !op->remove : isActive(id) )
+            {
+                tailBytes += (NULL != op) ? op->bufLen : fileTable[id].size;
+                tailCount++;
+            }
+        }
+        // Gaps in front of the first touched file can leave too little room behind it,
+        //   then the whole data section is laid out again (commit() checked that fits)
+        if ( (tailBytes <= eepromSize - tailStart) || (firstFileAddr == tailStart) )
+        {
+            break;
+        }
+        first = 0;
+        tailStart = firstFileAddr;
+    }
+    if ( 0 != tailCount )
+    {
+        headroom = std::min(static_cast<uint32_t>(header.slack), (eepromSize - tailStart - tailBytes) / tailCount);
+    }
+
+    // New start of every file, the old data of the files being replaced is no longer needed
+    for ( id = 0; id < numFiles; id++ )
+    {
+        fileTarget[id] = fileTable[id].startAddress;
+    }
+    cursor = tailStart;
+    for ( id = first; id < numFiles; id++ )
+    {
+        op = transaction.find(id);
+        if ( NULL != op )
+        {
+            if ( isActive(id) )
+            {
+                bytesUsed -= fileTable[id].size;
+                std::memset(&fileTable[id], 0, sizeof(fileEntry_t));
+                clearActive(id);
+            }
+            if ( op->remove )
+            {
+                continue;
+            }
+            fileTarget[id] = cursor;
+            cursor += op->bufLen + headroom;
+        }
+        else if ( isActive(id) )
+        {
+            fileTarget[id] = cursor;
+            cursor += fileTable[id].size + headroom;
+        }
+    }
+
+    // Files the transaction does not touch keep their data but may have to move
+    moveFiles();
+
+    // Then the new data and table entries of the files the transaction writes
+    for ( uint32_t i = 0; i < transaction.operationCount; i++ )
+    {
+        op = &transaction.operations[i];
+        if ( !op->remove )
+        {
+            std::memcpy(disk + fileTarget[op->fileId], op->writeBuf, op->bufLen);
+            fileTable[op->fileId].startAddress = fileTarget[op->fileId];
+            fileTable[op->fileId].size = op->bufLen;
+            fileTable[op->fileId].crc = eepromCrc32(op->writeBuf, op->bufLen);
+            fileTable[op->fileId].flags = op->fileFlags;
+            setActive(op->fileId);
+            bytesUsed += op->bufLen;
+        }
+        setQuarantined(op->fileId, false);
+        updateHandle(op->fileId);
+    }
+
+    // Don't leave remnants of old data in the gaps
+    last = lastActiveFile();
+    cursor = (EEPROM_NO_FILE == last) ? firstFileAddr : fileTable[last].startAddress + fileTable[last].size;
+    eraseGaps(tailStart, std::max(oldEnd, cursor));
+
+    return commitChanges(); // program only the modified spans of the disk image
+}
+
+bool EEPROMFS::commitLog(EEPROMTransaction& transaction)
+{
+    uint32_t appendBytes = 0;
+    uint32_t i;
+
+    for ( i = 0; i < transaction.operationCount; i++ )
+    {
+        appendBytes += transaction.operations[i].remove ? 0 : transaction.operations[i].bufLen;
+    }
+
+    // Make room at the head for all new versions together
+    if ( header.logHead + appendBytes > eepromSize )
+    {
+        compactLog(true);
+    }
+    // Still no room: drop the current versions of the files being replaced and slide
+    // everything else over them. As with a single write this is not safe against power loss.
+    if ( header.logHead + appendBytes > eepromSize )
+    {
+        for ( i = 0; i < transaction.operationCount; i++ )
+        {
+            fileId_t id = transaction.operations[i].fileId;
+
+            if ( isActive(id) )
+            {
+                bytesUsed -= fileTable[id].size;
+                std::memset(&fileTable[id], 0, sizeof(fileEntry_t));
+                clearActive(id);
+            }
+        }
+        compactLog(false);
+
+        // commit() already checked everything fits in the free space
+        if ( header.logHead + appendBytes > eepromSize )
+        {
+            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
+            return false;
+        }
+    }
+
+    // Append the new versions, the old ones stay intact until the table below is committed
+    for ( i = 0; i < transaction.operationCount; i++ )
+    {
+        const EEPROMTransaction::operation_t* op = &transaction.operations[i];
+
+        if ( isActive(op->fileId) )
+        {
+            bytesUsed -= fileTable[op->fileId].size;
+        }
+        if ( op->remove )
+        {
+            std::memset(&fileTable[op->fileId], 0, sizeof(fileEntry_t));
+            clearActive(op->fileId);
+        }
+        else
+        {
+            std::memcpy(disk + header.logHead, op->writeBuf, op->bufLen);
+            markDirty(header.logHead, op->bufLen);
+            fileTable[op->fileId].startAddress = header.logHead;
+            fileTable[op->fileId].size = op->bufLen;
+            fileTable[op->fileId].crc = eepromCrc32(op->writeBuf, op->bufLen);
+            fileTable[op->fileId].flags = op->fileFlags;
+            header.logHead += op->bufLen;
+            setActive(op->fileId);
+            bytesUsed += op->bufLen;
+        }
+        setQuarantined(op->fileId, false);
+        updateHandle(op->fileId);
+    }
+
+    return commitChanges(); // program only the modified spans of the disk image
+}
+
+bool EEPROMFS::checkText(const uint8_t* buf, uint32_t len, uint16_t fileFlags)
+{
+    uint32_t bad;
+
+    if ( 0 != (fileFlags & (EEPROM_FILE_FLAG_BINARY | EEPROM_FILE_FLAG_RING)) )
+    {
+        return true;
+    }
+    bad = eepromFindInvalidText(buf, len);
+    if ( bad == len )
+    {
+        return true;
+    }
+
+    // A text character is only out of place if a NUL came before it
+    if ( NULL != std::memchr(buf, 0, bad) )
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_UNEXPECTED_NULLS, bad);
+    }
+    else
+    {
+        status.setStatus(EEPROMStatus::EEPROM_ERROR_NON_ASCII, bad);
+    }
+    return false;
+}
+
+uint32_t EEPROMFS::sortFilesByAddress()
+{
+    uint32_t count = 0;
+
+    for ( fileId_t id = firstActiveFile(); id != EEPROM_NO_FILE; id = nextActiveFile(id) )
+    {
+        addressOrder[count++] = id;
+    }
+    // An empty file can share its start address with the file after it, it has to sort first
+    std::sort(addressOrder, addressOrder + count,
+              [this](fileId_t a, fileId_t b) {
+                  return (fileTable[a].startAddress < fileTable[b].startAddress) ||
+                         ((fileTable[a].startAddress == fileTable[b].startAddress) && (fileTable[a].size < fileTable[b].size));
+              });
+
+    return count;
+}
+
+bool EEPROMFS::verifyFile(fileId_t index)
+{
+    const uint8_t* data = disk + fileTable[index].startAddress;
+    uint32_t bad;
+
+    // Entries written by a newer build may carry options we do not know how to honour
+    if ( 0 != (fileTable[index].flags & ~EEPROM_FILE_FLAGS) )
+    {
+        return false;
+    }
+    // Ring files are updated without touching the table and carry no checksum,
+    //   but their state word has to point into the ring
+    if ( 0 != (fileTable[index].flags & EEPROM_FILE_FLAG_RING) )
+    {
+        uint32_t state;
+
+        if ( EEPROM_RING_STATE_SIZE >= fileTable[index].size )
+        {
+            return false;
+        }
+        std::memcpy(&state, data, sizeof(state));
+        return ((state & ~EEPROM_RING_FULL) < fileTable[index].size - EEPROM_RING_STATE_SIZE);
+    }
+    if ( fileTable[index].crc != eepromCrc32(data, fileTable[index].size) )
+    {
+        return false;
+    }
+    // Binary files have no content rules, trusted images skip the scan
+    if ( (0 != (fileTable[index].flags & EEPROM_FILE_FLAG_BINARY)) ||
+         (0 != (header.flags & EEPROM_FS_FLAG_TRUST_CRC)) )
+    {
+        return true;
+    }
+
+    // Verify the file is ASCII string operation safe (text followed only by NUL padding)
+    bad = eepromFindInvalidText(data, fileTable[index].size);
+    if ( bad != fileTable[index].size )
+    {
+        debugPrint("EEPROMFS: file %u has an invalid byte at offset %u\n", index, bad);
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t EEPROMFS::fileChecksum(fileId_t index)
+{
+    if ( 0 != (fileTable[index].flags & EEPROM_FILE_FLAG_RING) )
+    {
+        return 0;
+    }
+    return eepromCrc32(disk + fileTable[index].startAddress, fileTable[index].size);
+}
+
+bool EEPROMFS::isReserved(fileId_t fileId)
+{
+    return ( (0 != (header.flags & EEPROM_FS_FLAG_NAMES)) && (fileId == numFiles - 1) );
+}
+
+void EEPROMFS::loadDirectory()
+{
+    const dirEntry_t* directory;
+    uint32_t dirCount;
+    fileId_t dirId = numFiles - 1;
+
+    std::memset(nameIndex, 0xFF, sizeof(nameIndex));
+    if ( (0 == (header.flags & EEPROM_FS_FLAG_NAMES)) || (0 == numFiles) ||
+         !isActive(dirId) || isQuarantined(dirId) )
+    {
+        return;
+    }
+
+    // A directory never holds more names than there are ids to bind them to, which also
+    //   keeps the index at most half full
+    directory = (const dirEntry_t *)(disk + fileTable[dirId].startAddress);
+    dirCount = std::min(fileTable[dirId].size / static_cast<uint32_t>(sizeof(dirEntry_t)), static_cast<uint32_t>(dirId));
+    for ( uint32_t entry = 0; entry < dirCount; entry++ )
+    {
+        uint32_t slot = directory[entry].hash & (EEPROM_NAME_INDEX_SIZE - 1);
+
+        // Entries pointing outside the usable ids are not handed out
+        if ( directory[entry].fileId >= dirId )
+        {
+            continue;
+        }
+        while ( EEPROM_NO_FILE != nameIndex[slot] )
+        {
+            slot = nextNameSlot(slot);
+        }
+        nameIndex[slot] = entry;
+    }
+}
+
+uint32_t EEPROMFS::findName(const char* name)
+{
+    uint32_t hash = eepromNameHash(name, EEPROM_MAX_NAME_LEN);
+
+    // Only an entry with the same hash gets a string compare, normally just the one looked for
+    for ( uint32_t slot = hash & (EEPROM_NAME_INDEX_SIZE - 1); EEPROM_NO_FILE != nameIndex[slot]; slot = nextNameSlot(slot) )
+    {
+        const dirEntry_t* entry = (const dirEntry_t *)(disk + fileTable[numFiles - 1].startAddress) + nameIndex[slot];
+
+        if ( (hash == entry->hash) && (0 == std::strncmp(entry->name, name, EEPROM_MAX_NAME_LEN)) )
+        {
+            return nameIndex[slot];
+        }
+    }
+    return EEPROM_NO_FILE;
+}
+
+void EEPROMFS::setQuarantined(fileId_t index, bool quarantined)
+{
+    bool wasQuarantined = (0 != (quarantineBitmap[index >> 5] & (1u << (index & 0x1F))));
+
+    if ( quarantined && !wasQuarantined )
+    {
+        quarantineBitmap[index >> 5] |= (1u << (index & 0x1F));
+        quarantinedFileCount++;
+    }
+    else if ( !quarantined && wasQuarantined )
+    {
+        quarantineBitmap[index >> 5] &= ~(1u << (index & 0x1F));
+        quarantinedFileCount--;
+    }
+}
+
+uint32_t EEPROMFS::tableChecksum(const fsHeader_t* slotHeader, const fileEntry_t* table)
+{
+    uint32_t crc;
+
+    crc = eepromCrc32((const uint8_t *)slotHeader, offsetof(fsHeader_t, tableCrc));
+    return eepromCrc32((const uint8_t *)table, slotHeader->numFiles * sizeof(fileEntry_t), crc);
+}
+
+bool EEPROMFS::isActive(fileId_t index)
+{
+    return (0 != (activeBitmap[index >> 5] & (1u << (index & 0x1F))));
+}
+
+fileId_t EEPROMFS::firstActiveFile()
+{
+    return nextActive[0];
+}
+
+fileId_t EEPROMFS::lastActiveFile()
+{
+    return prevActive[numFiles];
+}
+
+fileId_t EEPROMFS::nextActiveFile(fileId_t index)
+{
+    return nextActive[index + 1];
+}
+
+fileId_t EEPROMFS::prevActiveFile(fileId_t index)
+{
+    return prevActive[index];
+}
+
+void EEPROMFS::setActive(fileId_t index)
+{
+    uint32_t i;
+
+    if ( isActive(index) )
+    {
+        return;
+    }
+    activeBitmap[index >> 5] |= (1u << (index & 0x1F));
+    activeFileCount++;
+
+    // Positions between the previous active file and index now find index as their next file
+    //   (EEPROM_NO_FILE compares greater than any fileId)
+    for ( i = index + 1; (i > 0) && (nextActive[i - 1] > index); i-- )
+    {
+        nextActive[i - 1] = index;
+    }
+    // Positions between index and the next active file now find index as their previous file
+    for ( i = index + 1; (i <= numFiles) && ((EEPROM_NO_FILE == prevActive[i]) || (prevActive[i] < index)); i++ )
+    {
+        prevActive[i] = index;
+    }
+}
+
+void EEPROMFS::clearActive(fileId_t index)
+{
+    uint32_t i;
+
+    if ( !isActive(index) )
+    {
+        return;
+    }
+    activeBitmap[index >> 5] &= ~(1u << (index & 0x1F));
+    activeFileCount--;
+
+    // Hand the positions that pointed at index over to its neighbours
+    for ( i = index + 1; (i > 0) && (nextActive[i - 1] == index); i-- )
+    {
+        nextActive[i - 1] = nextActive[index + 1];
+    }
+    for ( i = index + 1; (i <= numFiles) && (prevActive[i] == index); i++ )
+    {
+        prevActive[i] = prevActive[index];
     }
+}
 
-    if ( startAddress + len > eepromSize )
+void EEPROMFS::resetActiveFiles()
+{
+    std::memset(activeBitmap, 0, sizeof(activeBitmap));
+    for ( uint32_t i = 0; i <= EEPROM_MAX_NUM_FILES; i++ )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
-        return false;
+        nextActive[i] = EEPROM_NO_FILE;
+        prevActive[i] = EEPROM_NO_FILE;
     }
+    activeFileCount = 0;
+}
 
-#if defined(__linux__)
-    int32_t size;
-    std::fstream fs;
+void EEPROMFS::markDirty(uint32_t address, uint32_t len)
+{
+    uint32_t start;
+    uint32_t end;
+    uint8_t i;
 
-    fs.open(UNIX_NONVOLATILE_FILE, std::ios::in | std::ios::binary | std::ios::ate);
-    if ( !fs.is_open() )
+    if ( 0 == len )
     {
-        fs.close();
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-        return false;
+        return;
     }
 
-    size = fs.tellg();
-    // check for epic failure
-    if ( -1 == size )
+    // EEPROM programming works on whole words, so widen the range to word boundaries
+    start = address & ~0x03u;
+    end = (address + len + 3) & ~0x03u;
+    if ( end > eepromSize )
     {
-        fs.close();
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-        return false;
+        end = eepromSize;
     }
-    // Ensure the size is as expected
-    if ( static_cast<uint32_t>(size) != eepromSize )
+
+    // Absorb every existing range that overlaps or touches the new one
+    i = 0;
+    while ( i < dirtyCount )
     {
-        fs.close();
-        // nuke entire EEPROM - set to FF's
-        if ( 0 != EEPROMMassErase() )
+        if ( (dirtyRanges[i].start <= end) && (start <= dirtyRanges[i].end) )
         {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-            return false;
+            start = std::min(start, dirtyRanges[i].start);
+            end = std::max(end, dirtyRanges[i].end);
+            dirtyRanges[i] = dirtyRanges[--dirtyCount];
+        }
+        else
+        {
+            i++;
         }
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
-        return false;
     }
 
-    // Reset cursor to beginning of file
-    fs.seekg(0, std::ios::beg);
-    // allocate memory:
-    char* buffer = new char [size];
-    // read data as a block:
-    fs.read(buffer, size);
-    fs.close();
+    // Out of slots: fold the new range into whichever existing range is closest to it
+    if ( EEPROM_MAX_DIRTY_RANGES == dirtyCount )
+    {
+        uint8_t closest = 0;
+        uint32_t closestGap = UINT32_MAX;
 
-    // Modify memory starting at desired startAddress
-    std::memcpy(&buffer[startAddress], buf, len);
+        for ( i = 0; i < dirtyCount; i++ )
+        {
+            uint32_t gap = (dirtyRanges[i].end < start) ? (start - dirtyRanges[i].end) : (dirtyRanges[i].start - end);
+            if ( gap < closestGap )
+            {
+                closestGap = gap;
+                closest = i;
+            }
+        }
+        start = std::min(start, dirtyRanges[closest].start);
+        end = std::max(end, dirtyRanges[closest].end);
+        dirtyRanges[closest] = dirtyRanges[--dirtyCount];
 
-    // Write contents back out to file
-    fs.open(UNIX_NONVOLATILE_FILE, std::ios::out | std::ios::binary);
-    if ( !fs.is_open() )
-    {
-        fs.close();
-        delete[] buffer;
-        return false;
-    }
-    fs.write(buffer, size);
-    fs.close();
-    delete[] buffer;
-#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
-    // API returns 0 on success, otherwise API-specific error code we don't want to get into
-    if ( 0 != EEPROMProgram((uint32_t*)buf, startAddress, len) )
-    {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_WRITE_ERROR);
-        return false;
+        // The widened range may now reach others, so run it through the merge again
+        markDirty(start, end - start);
+        return;
     }
-#else // Assert failure
-    #error Environment must either be defined as __linux__ or TIVAWARE. Add additional support for new environments as needed.
-#endif
 
-    status.setStatus(EEPROMStatus::EEPROM_OK);
-    return true;
+    dirtyRanges[dirtyCount].start = start;
+    dirtyRanges[dirtyCount].end = end;
+    dirtyCount++;
 }
 
-bool EEPROMFS::init()
+void EEPROMFS::stage(uint32_t address, const void* src, uint32_t len)
 {
-    bool success;
+    const uint8_t* bytes = (const uint8_t*)src;
+    uint32_t i = 0;
 
-    if ( EEPROM_INIT_OK == EEPROMInit() )
+    while ( i < len )
     {
-        hwInitialized = true;
-        eepromSize = EEPROMSizeGet();
-        if ( eepromSize <= EEPROM_FIRST_FILE_ADDR )
+        uint32_t runStart;
+
+        // skip over everything the image already holds
+        if ( disk[address + i] == bytes[i] )
         {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
-            success = false;
+            i++;
+            continue;
         }
-        else
+        // copy and mark the run of bytes that differ
+        runStart = i;
+        while ( (i < len) && (disk[address + i] != bytes[i]) )
         {
-            // Allocate a word-aligned block of memory to use as a disk image
-            // Since we're using uint32_t to accomplish this, we only need 1/4 as many units of memory
-            wordAlignedDisk = new (std::nothrow) uint32_t[(eepromSize>>2)];
-            // copy the address of the allocated space to our uint8_t* pointer
-            disk = (uint8_t*)wordAlignedDisk;
-            if ( NULL == disk )
-            {
-                status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_MEMORY);
-                success = false;
-            }
-            else
-            {
-                fileTable = (fileEntry_t *)disk; // set pointer to fileTable at start of disk
-                validFileSystemTable = validateFileSystem(); // this also sets the status
-                success = true; // we return true even if the filesystem has no valid table - that's reflected in the status message
-            }
+            disk[address + i] = bytes[i];
+            i++;
         }
+        markDirty(address + runStart, i - runStart);
     }
-    else
-    {
-        status.setStatus(EEPROMStatus:: EEPROM_ERROR_API);
-        success = false;
-    }
-
-    return success;
 }
 
-bool EEPROMFS::validateFileSystem()
+bool EEPROMFS::commitTable()
 {
-    uint32_t i;
+    uint8_t nextSlot = (currentSlot + 1) % header.numSlots;
+    uint32_t slotAddress = EEPROM_HEADER_ADDR + (nextSlot * slotSize);
+    uint32_t committedSequence = header.sequence;
 
-    // initially, assume we're going to fail, update with specific failure types if we can
-    status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
-    validFileSystemTable = false;
+    statsAdd(tableCommits, 1);
 
-    // reset properties
-    activeFiles.clear();
-    bytesUsed = EEPROM_FIRST_FILE_ADDR; // at a minimum, we're using a portion for the file system table
+#if defined(EEPROM_FS_SNAPSHOTS)
+    // The RAM image is final at this point and readers of handles already see it
+    publishSnapshot();
+#endif
 
-    // read our entire "disk" into memory
-    if ( eepromSize != read(disk, EEPROM_FTABLE_ADDR, eepromSize) )
+    // Phase 1: everything the new table refers to has to be in the EEPROM before the table is
+    if ( ! flush() )
     {
-        bytesUsed = 0; // we've failed
         return false;
     }
 
-    status.setStatus(EEPROMStatus::EEPROM_ERROR_INVALID_FILE_SYSTEM_TABLE);
+    // Phase 2: header and table of the next slot. The checksum covers the new sequence number,
+    //   but the slot keeps the one it already has, so until phase 3 it is ignored at mount time
+    header.sequence = committedSequence + 1;
+    header.tableCrc = tableChecksum(&header, fileTable);
+    header.sequence = ((const fsHeader_t *)(disk + slotAddress))->sequence;
+    stage(slotAddress, &header, sizeof(fsHeader_t));
+    stage(slotAddress + EEPROM_FTABLE_OFFSET, fileTable, numFiles * sizeof(fileEntry_t));
+    if ( ! flush() )
+    {
+        header.sequence = committedSequence;
+        return false;
+    }
+
+    // Phase 3: a single word write makes the slot current
+    header.sequence = committedSequence + 1;
+    stage(slotAddress + offsetof(fsHeader_t, sequence), &header.sequence, sizeof(header.sequence));
+    if ( ! flush() )
+    {
+        header.sequence = committedSequence;
+        return false;
+    }
+    currentSlot = nextSlot;
+    syncPending = false;
 
-    uint32_t lastEndPoint = EEPROM_FIRST_FILE_ADDR; // the very first occurs at start of file data section
+    return true;
+}
 
-    // Verify the table is reasonable
-    for ( i = 0; i < EEPROM_MAX_NUM_FILES; i++ )
+bool EEPROMFS::commitChanges()
+{
+    uint32_t dirtyBytes = 0;
+
+    if ( !writeBack )
     {
-        // Check for a disabled entry (zeroed out startAddress), verify size is also disabled
-        if ( fileTable[i].startAddress == 0 && fileTable[i].size != 0 )
-        {
-            bytesUsed = 0; // we've failed
-            return false;
-        }
-        // If the entry is purely disabled, skip and go to next entry
-        else if ( fileTable[i].startAddress == 0 && fileTable[i].size == 0 )
-        {
-            continue;
-        }
-        // If it's enabled, verify it comes after end of last file
-        else if ( fileTable[i].startAddress < lastEndPoint )
-        {
-            bytesUsed = 0; // we've failed
-            return false;
-        }
-        // If the file's address is good, verify length is reasonable given size and place in EEPROM
-        else if ( (fileTable[i].startAddress + fileTable[i].size) > eepromSize )
-        {
-            bytesUsed = 0; // we've failed
-            return false;
-        }
+        return commitTable();
+    }
 
-        activeFiles.insert(i);
-        lastEndPoint = fileTable[i].startAddress + fileTable[i].size; // update pointer to end of this file
-        bytesUsed += fileTable[i].size; // add file usage to total amount tracked
+    for ( uint8_t i = 0; i < dirtyCount; i++ )
+    {
+        dirtyBytes += dirtyRanges[i].end - dirtyRanges[i].start;
+    }
+    if ( dirtyBytes >= writeBackMaxDirty )
+    {
+        return commitTable();
+    }
+
+#if defined(EEPROM_FS_SNAPSHOTS)
+    // Readers see the update now, the EEPROM at the next sync
+    publishSnapshot();
+#endif
+    statsAdd(deferredCommits, 1);
+    syncPending = true;
+    lastUpdateAt = writeBackClock();
+    status.setStatus(EEPROMStatus::EEPROM_OK);
+
+    return true;
+}
+
+bool EEPROMFS::flush()
+{
+#if defined(EEPROM_FS_STATS)
+    uint32_t flushed = 0;
+
+    if ( 0 < dirtyCount )
+    {
+        stats.flushes++;
     }
+#endif
 
-    // For each active file, verify that they are ASCII string operation safe (printable text and NULL terminated)
-    for ( uint8_t file : activeFiles )
+    while ( 0 < dirtyCount )
     {
-        uint32_t nullCount;
-        uint32_t j = 0;
+        dirtyRange_t* range = &dirtyRanges[dirtyCount - 1];
 
-        for ( nullCount = 0, j = 0; j < fileTable[file].size; j++ )
+        // Call to write() will set the EEPROM status property
+        if ( ! write(disk + range->start, range->start, range->end - range->start) )
         {
-            // Look for NULL, they (maybe more than one) should only appear at the end (not in the middle) of a file
-            if (0 == disk[fileTable[file].startAddress + j])
-            {
-                nullCount += 1;
-            }
-            // Look for non-printable characters
-            else if ( (' ' > disk[fileTable[file].startAddress + j]) && \
-                 (disk[fileTable[file].startAddress + j] > '~') )
-            {
-                status.setStatus(EEPROMStatus::EEPROM_ERROR_NON_ASCII);
-                // TODO: This sucks a little, because it will require the user
-                //   to nuke the entire EEPROM, where one file may be at fault
-                bytesUsed = 0; // we've failed
-                return false;
-            }
-            // This is a printable character. It should not come after any NULL character
-            else if ( 0 != nullCount )
-            {
-                status.setStatus(EEPROMStatus::EEPROM_ERROR_UNEXPECTED_NULLS);
-                // TODO: This sucks a little, because it will require the user
-                //   to nuke the entire EEPROM, where one file may be at fault
-                bytesUsed = 0; // we've failed
-                return false;
-            }
+            return false;
         }
+#if defined(EEPROM_FS_STATS)
+        stats.programOperations++;
+        stats.bytesProgrammed += range->end - range->start;
+        flushed += range->end - range->start;
+        stats.largestFlush = std::max(stats.largestFlush, flushed);
+#endif
+        dirtyCount--;
     }
 
-    // set the status and validFileSystemTable flags indicating everything is good!
-    status.setStatus(EEPROMStatus::EEPROM_OK);
-    validFileSystemTable = true;
-
-    return validFileSystemTable;
+    return true;
 }
 
-bool EEPROMFS::formatEEPROM()
+#if defined(EEPROM_FS_SNAPSHOTS)
+void EEPROMFS::publishSnapshot()
 {
-    uint32_t i;
-    bool writeStatus;
+    EEPROMSnapshot* snapshot = NULL;
+    uint32_t dataEnd = firstFileAddr;
 
-    // nuke entire EEPROM - set to FF's
-    if ( 0 != EEPROMMassErase() )
+    if ( !validFileSystemTable )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_API);
-        return false;
+        currentSnapshot = NULL;
+        return;
     }
 
-    bytesUsed = EEPROM_FIRST_FILE_ADDR;
-    // init file system table to zeros (all disabled)
-    for ( i = 0; i < EEPROM_MAX_NUM_FILES; i++ ) {
-        fileTable[i].startAddress = 0;
-        fileTable[i].size = 0;
+    // Reuse a snapshot nobody reads any more (acquireSnapshot() copes with a reader that
+    //   still grabs it in passing)
+    for ( uint32_t i = 0; (NULL == snapshot) && (i < EEPROM_SNAPSHOT_POOL_SIZE); i++ )
+    {
+        if ( (NULL != snapshots[i]) && (snapshots[i] != currentSnapshot.load()) &&
+             (0 == snapshots[i]->readers.load()) )
+        {
+            snapshot = snapshots[i];
+        }
+    }
+    // Readers hold all of them: the current one is out of date now, so there is none to hand out
+    if ( NULL == snapshot )
+    {
+        currentSnapshot = NULL;
+        return;
+    }
+
+    // Only the file data is of interest to readers
+    for ( fileId_t id = firstActiveFile(); id != EEPROM_NO_FILE; id = nextActiveFile(id) )
+    {
+        dataEnd = std::max(dataEnd, static_cast<uint32_t>(fileTable[id].startAddress) + fileTable[id].size);
     }
+    std::memcpy(snapshot->image + firstFileAddr, disk + firstFileAddr, dataEnd - firstFileAddr);
+    std::memcpy(snapshot->fileTable, fileTable, numFiles * sizeof(fileEntry_t));
+    std::memcpy(snapshot->quarantineBitmap, quarantineBitmap, sizeof(quarantineBitmap));
+    snapshot->numFiles = numFiles;
 
-    // Call to write() will set the EEPROM status property
-    writeStatus = write((uint8_t*)fileTable, EEPROM_FTABLE_ADDR, (EEPROM_MAX_NUM_FILES * sizeof(fileEntry_t)));
+    currentSnapshot = snapshot;
+}
+#endif
 
-    if ( !writeStatus )
+/*****************************************************************************************************/
+/* Snapshots                                                                                         */
+/*****************************************************************************************************/
+
+#if defined(EEPROM_FS_SNAPSHOTS)
+EEPROMSnapshot::EEPROMSnapshot(uint32_t imageSize) :
+    readers(0),
+    wordAlignedImage(new (std::nothrow) uint32_t[(imageSize + 3) >> 2]),
+    image((uint8_t*)wordAlignedImage),
+    numFiles(0)
+{
+}
+
+EEPROMSnapshot::~EEPROMSnapshot()
+{
+    delete[] wordAlignedImage;
+}
+
+const uint8_t* EEPROMSnapshot::getData(fileId_t fileId) const
+{
+    if ( (numFiles <= fileId) || (0 == fileTable[fileId].startAddress) ||
+         (0 != (quarantineBitmap[fileId >> 5] & (1u << (fileId & 0x1F)))) )
     {
-        bytesUsed = 0;
+        return NULL;
     }
+    return image + fileTable[fileId].startAddress;
+}
 
-    return writeStatus;
+eepromAddr_t EEPROMSnapshot::getSize(fileId_t fileId) const
+{
+    return (numFiles <= fileId) ? 0 : fileTable[fileId].size;
 }
 
-bool EEPROMFS::updateHandle(uint8_t index)
+uint16_t EEPROMSnapshot::getFlags(fileId_t fileId) const
 {
-    std::map<int, manager_t*>::iterator it;
+    return (numFiles <= fileId) ? 0 : fileTable[fileId].flags;
+}
+#endif
 
-    // Look for object managing file at given index
-    it = handleManager.find(index);
+/*****************************************************************************************************/
+/* Read views                                                                                        */
+/*****************************************************************************************************/
 
-    // If we don't have it in our map we've made an error somewhere
-    if ( it == handleManager.end() )
+EEPROMReadView::EEPROMReadView(EEPROMFS& fs, fileId_t fileId) :
+    fs(fs),
+#if defined(EEPROM_FS_SNAPSHOTS)
+    snapshot(fs.acquireSnapshot()),
+#endif
+    data(NULL),
+    size(0),
+    flags(0)
+{
+#if defined(EEPROM_FS_SNAPSHOTS)
+    if ( NULL != snapshot )
     {
-        return false;
+        data = snapshot->getData(fileId);
     }
-    else
+    if ( NULL != data )
+    {
+        size = snapshot->getSize(fileId);
+        flags = snapshot->getFlags(fileId);
+    }
+#else
+    fs.getReadLock();
+    if ( fs.validFileSystemTable && (fs.numFiles > fileId) && fs.isActive(fileId) && !fs.isQuarantined(fileId) )
     {
-        it->second->handle->size = fileTable[index].size;
-        it->second->handle->data = disk + fileTable[index].startAddress;
+        data = fs.disk + fs.fileTable[fileId].startAddress;
+        size = fs.fileTable[fileId].size;
+        flags = fs.fileTable[fileId].flags;
     }
+#endif
+}
 
-    return true;
+EEPROMReadView::~EEPROMReadView()
+{
+#if defined(EEPROM_FS_SNAPSHOTS)
+    fs.releaseSnapshot(snapshot);
+#else
+    fs.releaseReadLock();
+#endif
 }
 
-bool EEPROMFS::shiftFileData(uint8_t* headPtr, uint16_t size, int32_t distance)
+bool EEPROMReadView::isValid() const
 {
-    uint16_t i;
-    uint8_t *copyPtr;
-    int8_t dir;
+    return (NULL != data);
+}
 
-    // Sanity checks
-    // Are both headPtr and "tail pointer" within the range covered by "disk" buffer?
-    if ( (disk > headPtr) ||
-        ((headPtr - disk) > eepromSize) ||
-        ((headPtr + size) > (disk + eepromSize)) )
-    {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-        return false;
-    }
+const uint8_t* EEPROMReadView::getData() const
+{
+    return data;
+}
 
-    // Move to the "right"
-    if ( (distance > 0) && (distance < static_cast<int32_t>(eepromSize)) )
-    {
-        copyPtr = (headPtr + size - 1); // tail pointer
+uint32_t EEPROMReadView::getSize() const
+{
+    return size;
+}
 
-        // make sure the move will not fall off the end of the buffer
-        if ( (disk + eepromSize) < (copyPtr + distance) )
-        {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INSUFFICIENT_STORAGE);
-            return false;
-        }
+uint16_t EEPROMReadView::getFlags() const
+{
+    return flags;
+}
 
-        dir = -1; // moving the pointer to the "left" each iteration
-    }
-    // Move to the "left"
-    else if ( (distance < 0) && (distance > (-1 * static_cast<int32_t>(eepromSize))) )
-    {
-        copyPtr = headPtr;
+/*****************************************************************************************************/
+/* Transactions                                                                                      */
+/*****************************************************************************************************/
 
-        // make sure the move will not moves past the beginning of the buffer
-        if ( disk > (copyPtr + distance) ) // distance is negative
-        {
-            status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-            return false;
-        }
+EEPROMTransaction::EEPROMTransaction() :
+    operationCount(0)
+{
+}
 
-        dir = 1; // moving the pointer to the "right" each iteration
-    }
-    else
+bool EEPROMTransaction::writeFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags)
+{
+    operation_t* op = stage(fileId);
+
+    if ( NULL == op )
     {
         return false;
     }
+    op->remove = false;
+    op->writeBuf = writeBuf;
+    op->bufLen = bufLen;
+    op->fileFlags = fileFlags;
+
+    return true;
+}
+
+bool EEPROMTransaction::deleteFile(fileId_t fileId)
+{
+    operation_t* op = stage(fileId);
 
-    // Shift buffer section over by 'distance' bytes repetitively until entire section has been moved
-    for ( i = 0; i < size; i++ )
+    if ( NULL == op )
     {
-        *(copyPtr + distance) = *copyPtr;
-        // Invalidate where our old data used to be - don't want remnanats of data hanging around
-        *copyPtr = 0xFF;
-        // move pointer for next iteration
-        copyPtr += dir;
+        return false;
     }
+    op->remove = true;
+    op->writeBuf = NULL;
+    op->bufLen = 0;
+    op->fileFlags = 0;
 
     return true;
 }
 
-#if defined(__linux__)
-uint32_t EEPROMFS::FauxEEPROMMassErase()
+void EEPROMTransaction::clear()
+{
+    operationCount = 0;
+}
+
+uint32_t EEPROMTransaction::getOperationCount()
 {
-    std::fstream fs;
+    return operationCount;
+}
 
-    fs.open(UNIX_NONVOLATILE_FILE, std::ios::out);
-    if ( !fs.is_open() )
+EEPROMTransaction::operation_t* EEPROMTransaction::find(fileId_t fileId)
+{
+    for ( uint8_t i = 0; i < operationCount; i++ )
     {
-        status.setStatus(EEPROMStatus::EEPROM_ERROR_INTERNAL);
-        return 1; // anything other than zero is a failure flag
+        if ( operations[i].fileId == fileId )
+        {
+            return &operations[i];
+        }
     }
-    // fill the space with invalid data
-    const char filler[2] = { '\xff', 0 };
-    for ( uint32_t i = 0; i < eepromSize; i++ )
+    return NULL;
+}
+
+EEPROMTransaction::operation_t* EEPROMTransaction::stage(fileId_t fileId)
+{
+    operation_t* op = find(fileId);
+
+    if ( (NULL == op) && (EEPROM_MAX_TRANSACTION_OPS > operationCount) )
     {
-        fs.write(filler, 1);
+        op = &operations[operationCount++];
+        op->fileId = fileId;
     }
-    fs.close();
-
-    return 0;
+    return op;
 }
-#endif
 
 /******************************* EOF *******************************************/
 
@@ -22,13 +22,26 @@
 #include <cstdint>
 #include <vector>
 #include <map>
-#include <set>
+
+// Lock-free snapshot reads (see EEPROMSnapshot). Every update also publishes a copy of the
+//   file data, so this needs a copy of the image per snapshot of the pool on top of the
+//   image itself: define EEPROM_FS_SNAPSHOTS on builds that can afford it.
+#if defined(EEPROM_FS_SNAPSHOTS)
+    #include <atomic>
+
+// Number of snapshots allocated when the file system is mounted: the current one, one to
+//   publish the next update in, and one for every task that may hold a snapshot across an
+//   update. The default suits a single such task.
+#ifndef EEPROM_SNAPSHOT_POOL_SIZE
+#define EEPROM_SNAPSHOT_POOL_SIZE      3
+#endif
+#endif
 
 // OS-dependent semaphore/mutex mechanism
 #if defined(__linux__)
     #include <pthread.h>
-    // Define the type we're using for a lock
-    #define Lock_t pthread_mutex_t
+    // Define the type we're using for a lock (shared by readers, exclusive for writers)
+    #define Lock_t pthread_rwlock_t
 #elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
     #include <ti/sysbios/BIOS.h>
     #include <ti/sysbios/knl/Semaphore.h>
@@ -40,6 +53,83 @@
 #endif
 
 #include "EEPROMStatus.h"
+#include "EEPROMBackend.h"
+
+// Hot-path instrumentation (see EEPROMFS::getStats()). It costs a few counter updates per
+//   operation and two clock reads per exclusive lock, so it is only compiled in when
+//   EEPROM_FS_STATS is defined.
+#if defined(EEPROM_FS_STATS)
+// Buckets of the lock histograms: bucket 0 counts durations below 1us, bucket i durations
+//   of [2^(i-1), 2^i) us and the last bucket everything longer
+#define EEPROM_STATS_BUCKETS           16
+
+typedef struct _eepromStats_t
+{
+    // file data moved around inside the image to make room or to consolidate free space
+    uint64_t bytesMoved;
+    // flushes that programmed anything, the program operations and bytes they issued and
+    //   the most any single flush programmed (close to the image size means a full rewrite)
+    uint32_t flushes;
+    uint32_t programOperations;
+    uint64_t bytesProgrammed;
+    uint32_t largestFlush;
+    // table slot commits, and updates write-back mode left for a later one
+    uint32_t tableCommits;
+    uint32_t deferredCommits;
+    // packed images: complete re-layouts of the data section
+    uint32_t repacks;
+    // log-structured images: garbage collection passes
+    uint32_t compactions;
+    // open() calls, and how many of them had to fill in the handle (first open of a file)
+    uint32_t opens;
+    uint32_t handleFills;
+    // file system validations (mount and format)
+    uint32_t mounts;
+    // exclusive lock: acquisitions and log2 histograms of the time spent waiting for it and
+    //   holding it
+    uint32_t lockAcquisitions;
+    uint32_t lockWait[EEPROM_STATS_BUCKETS];
+    uint32_t lockHold[EEPROM_STATS_BUCKETS];
+} eepromStats_t;
+#endif
+
+// Wear accounting (see EEPROMFS::getHottestBlocks()). Every program operation bumps a RAM
+//   counter for each block it touches, which costs 4 bytes of RAM per block, so it is only
+//   compiled in when EEPROM_FS_WEAR is defined.
+#if defined(EEPROM_FS_WEAR)
+// Size of a wear accounting block; 64 bytes matches the 16 word blocks of the TM4C EEPROM
+#ifndef EEPROM_WEAR_BLOCK_SIZE
+#define EEPROM_WEAR_BLOCK_SIZE         64
+#endif
+
+// Program cycles a block is rated for when the caller does not say otherwise
+//   (the TM4C129 datasheet figure)
+#ifndef EEPROM_DEFAULT_ENDURANCE
+#define EEPROM_DEFAULT_ENDURANCE       500000
+#endif
+
+// Program count of one wear accounting block
+typedef struct _wearBlock_t
+{
+    // image address of the first byte of the block
+    uint32_t address;
+    // program operations that touched the block (a mass erase counts as one)
+    uint32_t programs;
+} wearBlock_t;
+#endif
+
+// On-media address format. By default file addresses and sizes are stored as 16-bit
+//   values, which limits the image to one word short of 64KB (the end of the image is
+//   itself a valid start address for an empty file). Define EEPROM_FS_WIDE_ADDRESSES to
+//   store them as 32-bit values for larger serial EEPROM/FRAM parts and host images.
+//   Images are not interchangeable between the two formats.
+#if defined(EEPROM_FS_WIDE_ADDRESSES)
+typedef uint32_t eepromAddr_t;
+#define EEPROM_MAX_IMAGE_SIZE          (UINT32_MAX - 3)
+#else
+typedef uint16_t eepromAddr_t;
+#define EEPROM_MAX_IMAGE_SIZE          (UINT16_MAX - 3)
+#endif
 
 
 // Handle to file provided to tasks that require file access
@@ -48,34 +138,263 @@
 // to maintain a task's ability to access their file as they change in memory
 typedef struct _handle_t {
     uint8_t* data;
-    uint8_t size;
+    eepromAddr_t size;
+    // EEPROM_FILE_FLAG_* of the file
+    uint16_t flags;
 } handle_t;
 
-// File system table has a fixed size to make it a little simpler
-#define EEPROM_MAX_NUM_FILES           20
+// File identifier (index into the file system table)
+typedef uint16_t fileId_t;
+
+// Number of entries in the file system table is chosen when formatting and
+//   recorded in the on-media header. This is the size used by format() by default.
+#define EEPROM_DEFAULT_NUM_FILES       20
+
+// Headroom (in bytes) format() gives every file of a packed image by default, see fsHeader_t::slack
+#ifndef EEPROM_DEFAULT_FILE_SLACK
+#define EEPROM_DEFAULT_FILE_SLACK      0
+#endif
+
+// Largest file system table this build can format or mount. It sizes the in-RAM
+//   active file index, so lower it on RAM constrained targets.
+#ifndef EEPROM_MAX_NUM_FILES
+#define EEPROM_MAX_NUM_FILES           256
+#endif
+
+// fileId_t value meaning "no file"
+#define EEPROM_NO_FILE                 UINT16_MAX
+
+#if EEPROM_MAX_NUM_FILES >= EEPROM_NO_FILE
+#error EEPROM_MAX_NUM_FILES must be smaller than EEPROM_NO_FILE
+#endif
+
+// Number of slots in the in-RAM hash index over the directory. Keep it a power of two of at
+//   least twice EEPROM_MAX_NUM_FILES, so probe sequences stay short.
+#ifndef EEPROM_NAME_INDEX_SIZE
+#define EEPROM_NAME_INDEX_SIZE         512
+#endif
+
+#if (0 != (EEPROM_NAME_INDEX_SIZE & (EEPROM_NAME_INDEX_SIZE - 1))) || (EEPROM_NAME_INDEX_SIZE < 2 * EEPROM_MAX_NUM_FILES)
+#error EEPROM_NAME_INDEX_SIZE must be a power of two of at least twice EEPROM_MAX_NUM_FILES
+#endif
+
+// Identifies a formatted image and its on-media layout revision
+#define EEPROM_FS_MAGIC                0x53464545  // "EEFS"
+#define EEPROM_FS_VERSION              4
+
+// Format options recorded in fsHeader_t::flags
+//   EEPROM_FS_FLAG_LOG: log-structured layout. Every new file version is appended at the
+//   head of a log instead of being packed in fileId order, and the space held by old
+//   versions is reclaimed by garbage collection once the head reaches the end of the image.
+#define EEPROM_FS_FLAG_LOG             0x01
+//   EEPROM_FS_FLAG_TRUST_CRC: files whose checksum matches skip the printable ASCII/NUL
+//   content scan at mount time, which is where most of the mount time goes on large images
+#define EEPROM_FS_FLAG_TRUST_CRC       0x02
+//   EEPROM_FS_FLAG_NAMES: keep a directory mapping file names to fileIds, so tasks can use
+//   open("wifi.cfg") instead of agreeing on numeric ids. The directory is stored as a binary
+//   file in the last table entry, which is reserved for it (usable ids are 0 to numFiles - 2).
+#define EEPROM_FS_FLAG_NAMES           0x04
+// Every flag this build understands
+#define EEPROM_FS_FLAGS                (EEPROM_FS_FLAG_LOG | EEPROM_FS_FLAG_TRUST_CRC | EEPROM_FS_FLAG_NAMES)
+
+// Size of the name field of a directory entry. Names are 1 to EEPROM_MAX_NAME_LEN - 1
+//   characters long and NUL padded on media.
+#define EEPROM_MAX_NAME_LEN            16
+
+// Entry of the directory file (EEPROM_FS_FLAG_NAMES). The directory is a plain array of these.
+typedef struct _dirEntry_t
+{
+    // hash of name, so lookups compare one word instead of the whole string
+    uint32_t hash;
+    // file the name is bound to
+    uint16_t fileId;
+    char name[EEPROM_MAX_NAME_LEN];
+} __attribute__ ((__packed__)) dirEntry_t;
+
+// Per-file options recorded in fileEntry_t::flags
+//   EEPROM_FILE_FLAG_BINARY: the file holds raw binary data of exactly fileEntry_t::size
+//   bytes. It is exempt from the text content check (its checksum is still verified).
+#define EEPROM_FILE_FLAG_BINARY        0x0001
+//   EEPROM_FILE_FLAG_RING: ring buffer created by createRingFile(). A 4 byte state word
+//   (next write offset plus EEPROM_RING_FULL once wrapped) is followed by the ring itself.
+//   Appends never touch the table, so ring files carry no checksum; only the state word
+//   is checked at mount time.
+#define EEPROM_FILE_FLAG_RING          0x0002
+// Every per-file flag this build understands
+#define EEPROM_FILE_FLAGS              (EEPROM_FILE_FLAG_BINARY | EEPROM_FILE_FLAG_RING)
+
+// Number of table slots format() uses unless told otherwise. With two or more slots a
+//   table update never overwrites the current table, so a power loss while it is being
+//   programmed leaves the previous table in charge.
+#define EEPROM_PACKED_TABLE_SLOTS      2
+#define EEPROM_LOG_TABLE_SLOTS         4
+
+// Largest number of table slots an image may rotate through
+#define EEPROM_MAX_TABLE_SLOTS         16
+
+// Header stored at the start of every table slot, directly followed by the file system table.
+//   The EEPROM starts with numSlots copies of header + table (each rounded up to whole words)
+//   and every table update goes to the slot after the current one, so the table wear is
+//   spread over all slots. The valid slot with the highest sequence number is current.
+//   The sequence number is programmed last and acts as the commit record of the slot:
+//   tableCrc covers the new sequence number, so the slot does not check out until it lands.
+typedef struct _fsHeader_t
+{
+    uint32_t magic;
+    uint8_t version;
+    // sizeof(eepromAddr_t) of the build that formatted the image
+    uint8_t addressWidth;
+    // number of entries in the file system table
+    uint16_t numFiles;
+    // number of table slots at the start of the EEPROM
+    uint8_t numSlots;
+    // EEPROM_FS_FLAG_* options chosen at format time
+    uint8_t flags;
+    // packed images: free bytes left behind a file whenever it is placed or moved, so it
+    //   can grow in place later without dragging the files after it along
+    uint16_t slack;
+    // incremented every time the table is written (keep word aligned, it is programmed on its own)
+    uint32_t sequence;
+    // log-structured images: address the next file version is appended at
+    uint32_t logHead;
+    // CRC-32 of the header up to this field followed by the file system table
+    uint32_t tableCrc;
+} __attribute__ ((__packed__)) fsHeader_t;
 
 // Structure containing single file entry in file system table.
-//   There will be EEPROM_MAX_NUM_FILES of this sequentially to create the full table.
+//   There will be fsHeader_t::numFiles of this sequentially to create the full table.
 typedef struct _fileEntry_t
 {
-    uint16_t startAddress;
-    uint16_t size;
+    eepromAddr_t startAddress;
+    eepromAddr_t size;
+    // CRC-32 of the file data
+    uint32_t crc;
+    // EEPROM_FILE_FLAG_* options of the file
+    uint16_t flags;
 } __attribute__ ((__packed__)) fileEntry_t;
 
+// Maximum number of disjoint dirty ranges tracked in the disk image between flushes.
+//   When more ranges than this are marked, the closest pair is merged into one span.
+#define EEPROM_MAX_DIRTY_RANGES        4
+
+// Write-back mode defaults (see EEPROMFS::setWriteBack()): sync once no update came in for
+//   this many milliseconds, or as soon as this many bytes of file data wait to be programmed
+#define EEPROM_WRITEBACK_IDLE_MS       1000
+#define EEPROM_WRITEBACK_MAX_DIRTY     256
+
+// Byte range [start, end) of the disk image that has been modified in RAM
+//   but not yet programmed into the EEPROM. Both ends are kept word aligned.
+typedef struct _dirtyRange_t
+{
+    uint32_t start;
+    uint32_t end;
+} dirtyRange_t;
+
 // Internal structure for managing file handles and reference counts to files
 typedef struct _manager_t
 {
     int handleCount;
-    handle_t* handle;
+    handle_t handle;
 } manager_t;
 
+// Maximum number of operations a single EEPROMTransaction can stage
+#ifndef EEPROM_MAX_TRANSACTION_OPS
+#define EEPROM_MAX_TRANSACTION_OPS     8
+#endif
+
+// A set of writes and deletes applied by EEPROMFS::commit() as one update.
+//   Staging only records the request; nothing is checked or copied until commit, so the
+//   buffers handed to writeFile() must stay valid until then. A later operation on the
+//   same fileId replaces the earlier one.
+class EEPROMTransaction
+{
+public:
+    EEPROMTransaction();
+
+    // Stage writing bufLen bytes from writeBuf to fileId (see EEPROMFS::writeFile())
+    // Returns false if the transaction is full
+    bool writeFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags = 0);
+
+    // Stage deleting fileId
+    // Returns false if the transaction is full
+    bool deleteFile(fileId_t fileId);
+
+    // Drop every staged operation
+    void clear();
+
+    // Return number of staged operations
+    uint32_t getOperationCount();
+
+private:
+    friend class EEPROMFS;
+
+    typedef struct _operation_t
+    {
+        fileId_t fileId;
+        // true for a delete, false for a write
+        bool remove;
+        uint8_t* writeBuf;
+        uint32_t bufLen;
+        uint16_t fileFlags;
+    } operation_t;
+
+    // Find the staged operation for fileId, or NULL
+    operation_t* find(fileId_t fileId);
+
+    // Slot for an operation on fileId: the one already staged for it or a new one
+    operation_t* stage(fileId_t fileId);
+
+    operation_t operations[EEPROM_MAX_TRANSACTION_OPS];
+    uint8_t operationCount;
+};
+
+#if defined(EEPROM_FS_SNAPSHOTS)
+// Read-only copy of the file system as of one completed update, handed out by
+//   EEPROMFS::acquireSnapshot(). It does not change while it is held, no matter what
+//   writers do in the meantime, and reading it needs no lock.
+class EEPROMSnapshot
+{
+public:
+    // Data of fileId, or NULL if the file does not exist or is quarantined
+    const uint8_t* getData(fileId_t fileId) const;
+
+    // Size / EEPROM_FILE_FLAG_* of fileId, 0 if it does not exist
+    eepromAddr_t getSize(fileId_t fileId) const;
+    uint16_t getFlags(fileId_t fileId) const;
+
+private:
+    friend class EEPROMFS;
+
+    EEPROMSnapshot(uint32_t imageSize);
+    ~EEPROMSnapshot();
+
+    // readers currently holding this snapshot; a snapshot is only recycled at zero
+    std::atomic<uint32_t> readers;
+
+    // file data at the same addresses as in the EEPROM
+    uint32_t* wordAlignedImage;
+    uint8_t* image;
+
+    fileId_t numFiles;
+    fileEntry_t fileTable[EEPROM_MAX_NUM_FILES];
+    uint32_t quarantineBitmap[(EEPROM_MAX_NUM_FILES + 31) / 32];
+};
+#endif
+
 
 class EEPROMFS
 {
+    friend class EEPROMReadView;
+
 public:
 
     // Constructor
-    EEPROMFS();
+    //   backend: storage medium to mount. The caller keeps ownership and it must outlive
+    //   this object. When NULL, the platform default is used (the nonvolatile.bin faux
+    //   EEPROM on Linux, the on-chip EEPROM on TIVAWARE).
+    //   imageSize: number of bytes of the medium used for the file system (multiple of 4).
+    //   Zero uses the whole medium. The Linux default backend is created with this size.
+    EEPROMFS(EEPROMBackend* backend = NULL, uint32_t imageSize = 0);
 
     // Destructor
     ~EEPROMFS();
@@ -89,46 +408,210 @@ public:
     // Return the used capacity
     uint32_t getUsedCapacity();
 
-    // Return size of activeFiles
+    // Return number of active files
     uint32_t getActiveFileCount();
 
     // Get EEPROM status
     EEPROMStatus getStatus();
 
+    // Return the number of entries in the file system table (highest usable fileId + 1)
+    uint32_t getMaxFileCount();
+
     // Get map containing list of active fileIds along with their file size
-    const std::map<uint8_t, uint16_t> getActiveFiles();
+    const std::map<fileId_t, eepromAddr_t> getActiveFiles();
+
+    // Return number of active files quarantined at mount time
+    //   A file whose checksum or content check fails is quarantined instead of failing the
+    //   whole file system: it keeps its space and stays in getActiveFiles(), but open()
+    //   refuses it with EEPROM_ERROR_CORRUPTED_FILE until it is rewritten or deleted.
+    uint32_t getQuarantinedFileCount();
+
+    // Return true if fileId was quarantined at mount time
+    bool isQuarantined(fileId_t fileId);
 
     // Tasks requiring access should call this to get a file handle
-    //   Internally, this calls 'new'
+    //   Handles are preallocated, so this never allocates memory
     //   It is fine for a task to have a handle open over its entire lifetime,
     //   but tasks should call close() prior to exit
     handle_t* open(int index);
 
+    // Named files (images formatted with EEPROM_FS_FLAG_NAMES): open the file bound to name.
+    //   The name is hashed once and resolved through the in-RAM index, so this costs the same
+    //   no matter how many files exist. Close it with close(lookup(name)).
+    handle_t* open(const char* name);
+
+    // Return the fileId bound to name, or EEPROM_NO_FILE if there is none
+    //   The binding outlives a deleteFile() by id; the file itself may not exist.
+    fileId_t lookup(const char* name);
+
     // Tasks need to call this prior to exiting.
     void close(int index);
 
     // Tasks must call this prior to any reading from their file handle to avoid collisions
+    //  Any number of tasks can hold the read lock at once, writers wait until all of them
+    //  have released it. Not recursive: a task must not take it again while holding it.
     //  Tasks should never write to their file handle's data pointer.
     //  Do not call this prior to writing - writeFile() calls it internally
     //  The pointer is not protected as a way of preventing memory
     //  duplication in constrained environments.
-    void getLock(void);
+    void getReadLock(void);
 
     // Tasks then call this when they're done reading
+    void releaseReadLock(void);
+
+    // Exclusive counterpart of getReadLock(), held by every call that changes the file system.
+    //  Tasks only need it to keep the file system unchanged across several calls.
+    void getLock(void);
+
+    // Release the exclusive lock
     void releaseLock(void);
 
+    // Write-back mode: updates change the RAM image, the handles and the snapshots right away,
+    //  but nothing is programmed until sync(), until syncIfIdle() finds no update came in for
+    //  idleMs, or until maxDirtyBytes of file data are waiting. A burst of writes then costs a
+    //  single flush and table commit. Updates not yet synced are lost on power loss.
+    //  Turning write-back mode off syncs whatever is pending. Returns false if that sync failed.
+    bool setWriteBack(bool enable, uint32_t idleMs = EEPROM_WRITEBACK_IDLE_MS,
+                      uint32_t maxDirtyBytes = EEPROM_WRITEBACK_MAX_DIRTY);
+
+    // Program every update write-back mode has held back (does not need enableWrite())
+    // Returns true if successful, false if there was an error
+    bool sync();
+
+    // sync() if updates are pending and none came in for the idle delay of setWriteBack()
+    //  Call it periodically, e.g. from a housekeeping task. Returns false if the sync failed.
+    bool syncIfIdle();
+
+    // True while write-back mode holds back updates that sync() would program
+    bool isSyncPending();
+
+#if defined(EEPROM_FS_STATS)
+    // Copy of the instrumentation counters gathered since construction or the last resetStats()
+    eepromStats_t getStats();
+
+    // Zero the instrumentation counters
+    void resetStats();
+#endif
+
+#if defined(EEPROM_FS_WEAR)
+    // Fill blocks with up to maxBlocks of the most programmed blocks, hottest first
+    //  Blocks that were never programmed are left out. Returns the number of entries filled in.
+    uint32_t getHottestBlocks(wearBlock_t* blocks, uint32_t maxBlocks);
+
+    // Program cycles the hottest block has left before it reaches endurance (0 once it has)
+    uint32_t getRemainingCycles(uint32_t endurance = EEPROM_DEFAULT_ENDURANCE);
+
+    // Projected remaining life of the part, in the unit of elapsed: how long the hottest block
+    //  lasts if it keeps being programmed at the rate it was over elapsed, the time the
+    //  counters cover. Returns UINT64_MAX while nothing has been programmed.
+    uint64_t forecastRemainingLife(uint64_t elapsed, uint32_t endurance = EEPROM_DEFAULT_ENDURANCE);
+
+    // The counters start at zero when the file system is constructed. To track wear across
+    //  power cycles, save them to a binary file now and then (every save programs the file,
+    //  so pick the interval accordingly) and add the saved counts back once after mounting.
+    //  Caller must call enableWrite() immediately prior to calling saveWearCounters()
+    bool saveWearCounters(fileId_t fileId);
+    bool loadWearCounters(fileId_t fileId);
+#endif
+
+#if defined(EEPROM_FS_SNAPSHOTS)
+    // Lock-free alternative to open() + getReadLock(): pin the file system as of the last
+    //  completed update. Never waits for writers and never holds them up; updates made
+    //  while it is held go into a new snapshot. Returns NULL if there is no valid file system,
+    //  or if readers held every snapshot of the pool (EEPROM_SNAPSHOT_POOL_SIZE) when the last
+    //  update came in; the first update after one is released publishes again.
+    //  Every snapshot must be handed back with releaseSnapshot() once the task is done with it.
+    const EEPROMSnapshot* acquireSnapshot();
+
+    // Hand a snapshot back so its memory can be reused for a later one
+    void releaseSnapshot(const EEPROMSnapshot* snapshot);
+#endif
+
     // Tasks call this method to write to new or replace existing files
     // This task will internally call getLock() to ensure no conflicts happen during write operations
     //   Caller must call enableWrite() immediately prior to calling this method
-    bool writeFile(uint8_t fileId, uint8_t* writeBuf, uint16_t bufLen);
+    //   fileFlags: EEPROM_FILE_FLAG_* options, e.g. EEPROM_FILE_FLAG_BINARY for raw binary data.
+    //   Text files (the default) must be printable text optionally followed by NUL padding.
+    //   Other text is refused with EEPROM_ERROR_NON_ASCII or EEPROM_ERROR_UNEXPECTED_NULLS,
+    //   and getStatus().offset() tells where in writeBuf the first offending byte is.
+    bool writeFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags = 0);
+
+    // Add bufLen bytes to the end of fileId, which has to exist already.
+    //   Only the new bytes and the file's table entry are programmed: the checksum is
+    //   extended instead of recomputed, and packed images grow the file into the gap behind
+    //   it where possible. Log-structured images copy the file to the log head to stay
+    //   safe against power loss.
+    //   On a ring file the bytes go into the ring instead, overwriting the oldest ones once
+    //   it is full; that costs the data plus one program of the state word.
+    //   On a text file the bytes go after the text, over the NUL padding, so the usual
+    //   strlen() + 1 writes can be appended to and the file stays string safe. The file only
+    //   grows by what does not fit into the padding. Packed images write such an append to a
+    //   copy next to the file when there is room, like writeFileAt().
+    //   Caller must call enableWrite() immediately prior to calling this method
+    bool appendToFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen);
+
+    // Create (or reset) fileId as an empty ring buffer holding the newest capacity bytes
+    //   appended to it. The whole reservation is allocated up front. Use appendToFile() to
+    //   add records and readRingFile() to read them back; writeFileAt() is refused.
+    //   Caller must call enableWrite() immediately prior to calling this method
+    bool createRingFile(fileId_t fileId, uint32_t capacity);
+
+    // Copy the newest min(bufLen, bytes held) bytes of ring file fileId into readBuf,
+    //   oldest first. Takes the read lock like readFileAt().
+    //   Returns the number of bytes copied (0 on error).
+    uint32_t readRingFile(fileId_t fileId, uint8_t* readBuf, uint32_t bufLen);
+
+    // pread()-style: copy up to bufLen bytes of fileId starting at offset into readBuf
+    //  Takes the read lock, so it runs alongside other readers (do not hold it when calling)
+    // Returns the number of bytes copied (0 at the end of the file or on error)
+    uint32_t readFileAt(fileId_t fileId, uint32_t offset, uint8_t* readBuf, uint32_t bufLen);
+
+    // pwrite()-style: overwrite bufLen bytes of fileId starting at offset. The range has to
+    //   lie within the file, the file size never changes (use writeFile() for that).
+    //   The patched file is written as a new copy so the update stays safe against power
+    //   loss: into a gap next to the file on packed images, at the log head on log-structured
+    //   ones. Only without room for a copy is the file patched in place, programming just the
+    //   bytes that changed plus the file's table entry.
+    //   Caller must call enableWrite() immediately prior to calling this method
+    bool writeFileAt(fileId_t fileId, uint32_t offset, uint8_t* writeBuf, uint32_t bufLen);
 
     // Tasks can call this method to delete files from the system and reclaim the space associated
     //   Caller must call enableWrite() immediately prior to calling this method
-    bool deleteFile(uint8_t fileId);
+    bool deleteFile(fileId_t fileId);
+
+    // Named counterparts of writeFile() and deleteFile(). Writing a new name binds it to the
+    //   lowest fileId that is neither in use nor bound to another name; the file and its
+    //   directory entry are committed as one update. Tasks addressing files by id should
+    //   stay clear of ids handed out this way.
+    //   Caller must call enableWrite() immediately prior to calling these methods
+    bool writeNamedFile(const char* name, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags = 0);
+    bool deleteNamedFile(const char* name);
+
+    // Apply every operation staged in transaction as one update: the new layout is computed
+    // once, data is moved once and the table is committed with a single flush. Either all
+    // operations land or none do (on log-structured images this also holds across a power
+    // loss, unless the log has to be compacted in place to make room). The transaction is
+    // cleared on success and left untouched on failure.
+    //   Caller must call enableWrite() immediately prior to calling this method
+    bool commit(EEPROMTransaction& transaction);
+
+    // Log-structured images only: move every live file version to the start of the data
+    //   section and reset the log head behind them. writeFile() does this on its own when
+    //   the head runs out of room; calling it from an idle/housekeeping task keeps that cost
+    //   out of the write path. Does nothing on packed images, which never hold garbage.
+    //   Caller must call enableWrite() immediately prior to calling this method
+    bool collectGarbage();
 
     // Public accessor for formatEEPROM(). This will erase entire contents of EEPROM and
-    //   initialize the file system table
-    bool format();
+    //   initialize the file system table with room for numFiles files
+    //   flags: EEPROM_FS_FLAG_* layout options
+    //   numSlots: number of table slots to rotate through, zero picks EEPROM_PACKED_TABLE_SLOTS
+    //   for packed images and EEPROM_LOG_TABLE_SLOTS for log-structured ones. A single slot
+    //   saves space but gives up the protection against power loss during table updates.
+    //   slack: packed images only, headroom in bytes to leave behind each file when it is
+    //   placed or moved, so frequently rewritten files can grow in place
+    bool format(fileId_t numFiles = EEPROM_DEFAULT_NUM_FILES, uint8_t flags = 0, uint8_t numSlots = 0,
+                uint16_t slack = EEPROM_DEFAULT_FILE_SLACK);
 
 private:
 
@@ -143,42 +626,225 @@ private:
     // NOTE: You must call enableWrite() prior to each call of this function
     bool write( uint8_t* buf, uint32_t startAddress, uint32_t len );
 
-    // Initialize the EEPROM hardware interface on the TM4C123
+    // Initialize the storage backend and load the file system from it
     bool init();
 
     // Verify file system table is reasonable
     bool validateFileSystem();
 
-    // Erase the contents of the file system table
-    bool formatEEPROM();
+    // Erase the contents of the EEPROM and write a header and empty table of numFiles entries
+    bool formatEEPROM(fileId_t numFiles, uint8_t flags, uint8_t numSlots, uint16_t slack);
+
+    // open() with the lock held and the index checked against numFiles
+    handle_t* openFile(fileId_t index);
 
     // Fills handle with info about file residing at index
     // Called upon initial handle creation and after any subsequent update of the file table
     // Returns boolean pass/fail success
-    bool updateHandle(uint8_t index);
+    bool updateHandle(fileId_t index);
+
+    // Shift data in the "disk" buffer from startAddress up to (not including) endAddress
+    // by "distance" bytes (positive moves "to the right", negative "to the left") with a
+    // single overlapping-safe block move, then fill the vacated bytes with 0xFF.
+    // It is important to note that you need to have room in the buffer on the side
+    // you are moving towards. Marks both the vacated and the newly occupied bytes as dirty.
+    bool shiftFileData(uint32_t startAddress, uint32_t endAddress, int32_t distance);
+
+    // Move the files "first" through "last" by "distance" bytes as one block (gaps between
+    // them included), then update their table entries and any open handles.
+    bool relocateFiles(fileId_t first, fileId_t last, int32_t distance);
+
+    // Packed images keep files in fileId order but allow gaps between them. Pick the start
+    // address for size bytes of fileId: an existing file keeps its place and grows into the
+    // gap behind it, a new one goes into the gap behind the file before it. If the gap is
+    // too small the files after it are shifted via makeRoom(). Returns false if the free
+    // space is too scattered for that, packFiles() then has to run first.
+    bool placeFile(fileId_t fileId, uint32_t size);
+
+    // Shift the files from "first" on to the right by at least need bytes, and by up to
+    // need + slack. Only the files up to the first gap that can absorb the shift move.
+    // Returns false if there is no such gap.
+    bool makeRoom(fileId_t first, uint32_t need);
+
+    // Lay all files out again from the start of the data section, giving each the same
+    // headroom (at most the image's slack) while keeping reserve bytes free at the end
+    void packFiles(uint32_t reserve);
+
+    // Move every active file to fileTarget[fileId]. The targets must keep the files in
+    // fileId order without overlaps; files moving left go first in ascending order, then
+    // files moving right in descending order, so no file lands on data still to be moved.
+    // Updates table entries and handles; dirty marking is left to eraseGaps().
+    void moveFiles();
+
+    // Fill every byte in [startAddress, endAddress) that does not belong to an active file
+    // with 0xFF and mark the whole range dirty
+    void eraseGaps(uint32_t startAddress, uint32_t endAddress);
+
+    // Packed images: start address for a new version of size bytes of the active file fileId
+    // that leaves its committed copy untouched, in the gap in front of or behind it. Returns 0
+    // if neither gap is big enough; the file then has to be rewritten in place.
+    uint32_t findCopySpace(fileId_t fileId, uint32_t size);
+
+    // Commit an update that moved a file to a copy found by findCopySpace() or deleted it, then
+    // erase the oldSize bytes of its old data at oldStart (left alone while write-back mode
+    // holds the update back, since the table in the EEPROM still refers to them)
+    bool commitThenErase(uint32_t oldStart, uint32_t oldSize);
+
+    // Log-structured images: place a new version of fileId at the log head, collecting
+    // garbage first if the head does not have room for it
+    bool appendFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags);
+
+    // Replace (or create) fileId with bufLen bytes of writeBuf, or zeros if writeBuf is NULL,
+    // and commit. Capacity has been checked by the caller, the lock is held.
+    bool storeFile(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen, uint16_t fileFlags);
+
+    // Write bufLen bytes into an active regular file at offset (at most its size), growing the
+    // file as far as they reach past its end, and commit
+    bool extendFile(fileId_t fileId, uint32_t offset, uint8_t* writeBuf, uint32_t bufLen);
+
+    // Write bufLen bytes into ring file fileId and advance its state word
+    bool appendRing(fileId_t fileId, uint8_t* writeBuf, uint32_t bufLen);
+
+    // Log-structured images: slide active files down towards the start of the data section
+    // in address order, update their table entries and handles and reset the log head.
+    // With safeOnly set, a file is only moved when its new location does not overlap its
+    // old one and the table is committed after each move, so a power loss never leaves a
+    // file without a valid copy; files that would overlap stay where they are. Otherwise
+    // everything is slid in RAM and left to the caller to commit.
+    void compactLog(bool safeOnly);
+
+    // Apply the checked operations of a transaction to the RAM image and table of a
+    // packed / log-structured image and commit them
+    bool commitPacked(EEPROMTransaction& transaction);
+    bool commitLog(EEPROMTransaction& transaction);
+
+    // Fill addressOrder with the active files sorted by start address, returns how many
+    uint32_t sortFilesByAddress();
+
+    // Check the data of an active file against its checksum and, unless the image trusts
+    // its checksums, its content. Returns false if the file has to be quarantined.
+    bool verifyFile(fileId_t index);
+
+    // Checksum recorded in the table for the current data of an active file
+    uint32_t fileChecksum(fileId_t index);
+
+    // True for the table entry holding the directory of a named image, which only the named
+    // calls may write
+    bool isReserved(fileId_t fileId);
+
+    // Text files (no EEPROM_FILE_FLAG_BINARY) have to pass the content check of the next mount,
+    // so writes check them first. Sets the status, with the offset of the first offending byte
+    // in buf, and returns false if len bytes at buf do not.
+    bool checkText(const uint8_t* buf, uint32_t len, uint16_t fileFlags);
+
+    // Rebuild nameIndex from the directory file
+    void loadDirectory();
+
+    // Directory entry number of name, or EEPROM_NO_FILE if it is not bound
+    uint32_t findName(const char* name);
+
+    // Put a file into / take it out of quarantine
+    void setQuarantined(fileId_t index, bool quarantined);
+
+    // CRC-32 of the header fields in front of tableCrc followed by the file system table
+    uint32_t tableChecksum(const fsHeader_t* slotHeader, const fileEntry_t* table);
+
+    // Active file index: a bitmap of active table entries plus, for every table position,
+    // the nearest active file at-or-after and at-or-before it. Lookups are O(1); marking a
+    // file active or inactive only touches the positions between it and its neighbours.
+    bool isActive(fileId_t index);
+    // First/last active file, or EEPROM_NO_FILE if there are none
+    fileId_t firstActiveFile();
+    fileId_t lastActiveFile();
+    // Nearest active file after/before index, or EEPROM_NO_FILE if there is none
+    fileId_t nextActiveFile(fileId_t index);
+    fileId_t prevActiveFile(fileId_t index);
+    void setActive(fileId_t index);
+    void clearActive(fileId_t index);
+    void resetActiveFiles();
+
+    // Record that len bytes of the disk image starting at address were modified in RAM.
+    //   The range is widened to word boundaries and merged with any overlapping range.
+    void markDirty(uint32_t address, uint32_t len);
+
+    // Copy len bytes from src into the disk image at address, marking only the bytes
+    // that actually change as dirty
+    void stage(uint32_t address, const void* src, uint32_t len);
+
+    // Two-phase table update: program all dirty file data, then header and table into the
+    // next table slot, and finally that slot's new sequence number. Until the last step lands
+    // the previous slot stays current, so a power loss rolls the update back.
+    // Returns true if successful, false if there was an error
+    bool commitTable();
 
-    // Shift data in the "disk" buffer over to the right to make room to insert new data
-    // Data from headPtr to tailPtr will be shifted "to the right" by the number of
-    // bytes listed in "distance".  It is important to note that you need to have room in
-    // the buffer *after* the tailPtr to accommodate shifting by that number of bytes.
-    bool shiftFileData(uint8_t* headPtr, uint16_t size, int32_t distance);
+    // End of every update: commitTable(), or in write-back mode leave the update pending
+    //   until the next sync
+    // Returns true if successful, false if there was an error
+    bool commitChanges();
 
-#if defined(__linux__)
-    uint32_t FauxEEPROMMassErase();
+    // Program all dirty ranges of the disk image into the EEPROM and clear them.
+    // Returns true if successful, false if there was an error
+    bool flush();
+
+#if defined(EEPROM_FS_SNAPSHOTS)
+    // Copy the file data and table into a snapshot no reader holds (allocating one if all
+    // are taken) and make it the current one, or clear the current one if the file system
+    // is not valid
+    void publishSnapshot();
 #endif
 
     // Lock access to the EEPROM_FS read/write functions
     Lock_t lock;
+#if defined(__linux__)
+    // serializes status updates of calls that only hold the read lock
+    pthread_mutex_t statusLock;
+#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
+    // TI-RTOS has no reader-writer lock: the first reader in takes lock on behalf of all
+    //   readers and the last one out releases it. readerLock guards readerCount, and the
+    //   status updates of calls that only hold the read lock.
+    Semaphore_Handle readerLock;
+    uint32_t readerCount;
+#endif
 
-    // pointer to array of file system table entries
-    fileEntry_t *fileTable;
+    // Set the status from a call holding only the read lock, where other readers may be
+    //   setting it at the same time
+    void setReadStatus(EEPROMStatus::eepromStatus_t value);
+
+    // platform storage used when no backend is supplied to the constructor
+#if defined(__linux__)
+    EEPROMFileBackend defaultBackend;
+#elif defined(TIVAWARE)  // Texas Instruments TI-RTOS
+    EEPROMTivaBackend defaultBackend;
+#endif
+
+    // storage medium holding the file system
+    EEPROMBackend* backend;
+
+    // working copy of the header of the current table slot
+    fsHeader_t header;
+
+    // working copy of the file system table, committed to the next slot on every update
+    fileEntry_t fileTable[EEPROM_MAX_NUM_FILES];
+
+    // number of entries in the file system table
+    fileId_t numFiles;
+
+    // size of one table slot (header and table rounded up to whole words)
+    uint32_t slotSize;
+
+    // slot the table was last committed to
+    uint8_t currentSlot;
+
+    // address of the start of the file data section (directly after the table slots)
+    uint32_t firstFileAddr;
 
     // keep file system data in memory - only access EEPROM when making changes
     uint32_t* wordAlignedDisk;
     uint8_t* disk;
 
-    // index into file for read/write
-    uint16_t readWriteIndex;
+    // ranges of the disk image that differ from the EEPROM contents
+    dirtyRange_t dirtyRanges[EEPROM_MAX_DIRTY_RANGES];
+    uint8_t dirtyCount;
 
     // flag indicating hw has been initialized and ready for access APIs
     bool hwInitialized;
@@ -195,19 +861,113 @@ private:
     // number of bytes used by files
     uint32_t bytesUsed;
 
-    // array of indexes indicating active files in file system table
-    std::set<uint8_t, std::less<uint8_t> > activeFiles;
+    // bitmap indicating active files in file system table
+    uint32_t activeBitmap[(EEPROM_MAX_NUM_FILES + 31) / 32];
+    // nextActive[i]: smallest active fileId >= i (entry numFiles is always EEPROM_NO_FILE)
+    fileId_t nextActive[EEPROM_MAX_NUM_FILES + 1];
+    // prevActive[i]: largest active fileId < i (entry 0 is always EEPROM_NO_FILE)
+    fileId_t prevActive[EEPROM_MAX_NUM_FILES + 1];
+    // number of active files
+    uint32_t activeFileCount;
+
+    // bitmap of active files that failed verification at mount time
+    uint32_t quarantineBitmap[(EEPROM_MAX_NUM_FILES + 31) / 32];
+    uint32_t quarantinedFileCount;
+
+    // scratch space for sortFilesByAddress()
+    fileId_t addressOrder[EEPROM_MAX_NUM_FILES];
+
+    // scratch space for moveFiles(): new start address of each file
+    eepromAddr_t fileTarget[EEPROM_MAX_NUM_FILES];
+
+    // open addressing hash index over the directory: entry numbers of the directory file,
+    //   placed by name hash, EEPROM_NO_FILE for an empty slot
+    uint16_t nameIndex[EEPROM_NAME_INDEX_SIZE];
+
+    // scratch space for writeNamedFile() and deleteNamedFile(): the rewritten directory
+    dirEntry_t newDirectory[EEPROM_MAX_NUM_FILES];
 
     // corrupted file system table flag
     //   true: valid file system table
     //   false: corrupted file system table
     bool validFileSystemTable;
 
+    // write-back mode settings (see setWriteBack())
+    bool writeBack;
+    uint32_t writeBackIdleMs;
+    uint32_t writeBackMaxDirty;
+
+    // updates made in write-back mode that have not been committed yet, and the clock
+    //   reading (in ms) of the last one
+    bool syncPending;
+    uint32_t lastUpdateAt;
+
     // status object (contains helper print method)
     EEPROMStatus status;
 
-    // Map to track file handles provided to tasks
-    std::map<int, manager_t*> handleManager;
+    // File handles provided to tasks and their reference counts, one slot per possible fileId
+    manager_t handleManager[EEPROM_MAX_NUM_FILES];
+
+#if defined(EEPROM_FS_STATS)
+    // instrumentation counters, only touched with the exclusive lock held
+    eepromStats_t stats;
+    // clock reading when the exclusive lock was taken
+    uint32_t lockTakenAt;
+#endif
+
+#if defined(EEPROM_FS_WEAR)
+    // program count of every EEPROM_WEAR_BLOCK_SIZE block of the image
+    uint32_t* wearCounters;
+    uint32_t wearBlocks;
+    // scratch space for saveWearCounters(): the counters as laid out in the file
+    uint32_t* wearImage;
+
+    // Count a program operation of len bytes at startAddress
+    void countWear(uint32_t startAddress, uint32_t len);
+#endif
+
+#if defined(EEPROM_FS_SNAPSHOTS)
+    // snapshot handed out by acquireSnapshot(), swapped atomically by publishSnapshot()
+    std::atomic<EEPROMSnapshot*> currentSnapshot;
+
+    // snapshots allocated by init(); they are recycled, not freed, so a reader racing with
+    // publishSnapshot() never touches freed memory
+    EEPROMSnapshot* snapshots[EEPROM_SNAPSHOT_POOL_SIZE];
+#endif
+};
+
+// Scoped, zero-copy read access to one file: pointer and length plus a pin that keeps them
+//   valid for the lifetime of the view, with no getReadLock()/releaseReadLock() pairing
+//   left to the caller. With EEPROM_FS_SNAPSHOTS the view pins a snapshot and never holds
+//   up writers; otherwise it holds the read lock, so writers wait until it goes out of
+//   scope and a task must not write while it holds one (or take a second view while
+//   another task may be waiting to write).
+class EEPROMReadView
+{
+public:
+    EEPROMReadView(EEPROMFS& fs, fileId_t fileId);
+    ~EEPROMReadView();
+
+    // false if the file does not exist or is quarantined, data is NULL and size 0 then
+    bool isValid() const;
+
+    const uint8_t* getData() const;
+    uint32_t getSize() const;
+    // EEPROM_FILE_FLAG_* of the file
+    uint16_t getFlags() const;
+
+private:
+    // a view owns its pin, it cannot be copied
+    EEPROMReadView(const EEPROMReadView&);
+    EEPROMReadView& operator=(const EEPROMReadView&);
+
+    EEPROMFS& fs;
+#if defined(EEPROM_FS_SNAPSHOTS)
+    const EEPROMSnapshot* snapshot;
+#endif
+    const uint8_t* data;
+    uint32_t size;
+    uint16_t flags;
 };
 
 #endif /* EEPROM_FS_H_ */
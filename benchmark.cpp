@@ -0,0 +1,240 @@
+/*
+  Copyright (C) 2020 Embed Creativity LLC
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Micro-benchmarks of the EEPROMFS operations.
+//   Every scenario times one operation per iteration and records the bytes the file system
+//   programmed for it; whatever puts the image back into shape for the next iteration is
+//   neither timed nor counted. Results go to stdout as CSV, one line per backend, layout
+//   and scenario, so runs can be diffed and tracked across releases:
+//
+//     ./benchmark [iterations] [image file]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "EEPROM_FS.h"
+
+// Image geometry: the 2KB default part, every file but the one a scenario works on in use
+#define BENCH_NUM_FILES         20
+#define BENCH_FILE_SIZE         40
+#define BENCH_MIDDLE_FILE       (BENCH_NUM_FILES / 2)
+#define BENCH_LAST_FILE         (BENCH_NUM_FILES - 2)
+#define BENCH_APPEND_SIZE       16
+#define BENCH_DEFAULT_ITERATIONS 1000
+
+// Backend counting the program operations and bytes going through it
+class CountingBackend : public EEPROMBackend
+{
+public:
+    CountingBackend(EEPROMBackend& target) : operations(0), programmed(0), target(target) {}
+
+    bool init() { return target.init(); }
+    uint32_t size() { return target.size(); }
+    bool read(uint8_t* buf, uint32_t address, uint32_t len) { return target.read(buf, address, len); }
+    bool program(const uint8_t* buf, uint32_t address, uint32_t len)
+    {
+        operations++;
+        programmed += len;
+        return target.program(buf, address, len);
+    }
+    bool massErase() { return target.massErase(); }
+
+    uint64_t operations;
+    uint64_t programmed;
+
+private:
+    EEPROMBackend& target;
+};
+
+// Samples of one scenario
+typedef struct _samples_t
+{
+    std::vector<uint64_t> ns;
+    uint64_t operations;
+    uint64_t programmed;
+} samples_t;
+
+// Content of every file written (appends restart once a file is 8 times its initial size)
+static uint8_t fileData[8 * BENCH_FILE_SIZE];
+
+// Time "op" (a lambda returning bool) once and add it to samples
+template <typename Op>
+static bool measure(CountingBackend& backend, samples_t& samples, Op op)
+{
+    uint64_t operations = backend.operations;
+    uint64_t programmed = backend.programmed;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool success = op();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    samples.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    samples.operations += backend.operations - operations;
+    samples.programmed += backend.programmed - programmed;
+    return success;
+}
+
+// Format the image and write every usable file except skip (EEPROM_NO_FILE for none)
+static bool populate(EEPROMFS& fs, uint8_t flags, fileId_t skip)
+{
+    fs.enableWrite();
+    if ( !fs.format(BENCH_NUM_FILES, flags) )
+    {
+        return false;
+    }
+    for ( fileId_t id = 0; id <= BENCH_LAST_FILE; id++ )
+    {
+        if ( id == skip )
+        {
+            continue;
+        }
+        fs.enableWrite();
+        if ( !fs.writeFile(id, fileData, BENCH_FILE_SIZE, EEPROM_FILE_FLAG_BINARY) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, uint32_t pct)
+{
+    return sorted[std::min(sorted.size() - 1, (sorted.size() * pct) / 100)];
+}
+
+static void report(const char* backendName, const char* layout, const char* scenario, samples_t& samples)
+{
+    std::sort(samples.ns.begin(), samples.ns.end());
+    printf("%s,%s,%s,%zu,%llu,%llu,%llu,%.1f,%.1f\n", backendName, layout, scenario, samples.ns.size(),
+           (unsigned long long)percentile(samples.ns, 50), (unsigned long long)percentile(samples.ns, 99),
+           (unsigned long long)samples.ns.back(),
+           (double)samples.operations / samples.ns.size(), (double)samples.programmed / samples.ns.size());
+}
+
+// Run every scenario against one backend and layout. Returns false if an operation failed.
+static bool runScenarios(const char* backendName, EEPROMBackend& target, uint8_t flags, uint32_t iterations)
+{
+    const char* layout = (0 != (flags & EEPROM_FS_FLAG_LOG)) ? "log" : "packed";
+    CountingBackend backend(target);
+    samples_t samples;
+    bool success = true;
+    EEPROMFS* fs = new EEPROMFS(&backend);
+
+#define BENCH_SCENARIO(name, setup, op, reset)                                              \
+    samples.ns.clear();                                                                     \
+    samples.operations = 0;                                                                 \
+    samples.programmed = 0;                                                                 \
+    success = success && (setup);                                                           \
+    for ( uint32_t i = 0; success && (i < iterations); i++ )                                \
+    {                                                                                       \
+        success = measure(backend, samples, [&]() { return (op); }) && (reset);             \
+    }                                                                                       \
+    if ( success )                                                                          \
+    {                                                                                       \
+        report(backendName, layout, name, samples);                                         \
+    }                                                                                       \
+    else                                                                                    \
+    {                                                                                       \
+        fprintf(stderr, "ERROR: %s/%s/%s failed: %s\n", backendName, layout, name,          \
+                fs->getStatus().c_str());                                                   \
+    }
+
+    // New file in front of all others / between them, removed again afterwards
+    BENCH_SCENARIO("insert-first",
+                   populate(*fs, flags, 0),
+                   (fs->enableWrite(), fs->writeFile(0, fileData, BENCH_FILE_SIZE, EEPROM_FILE_FLAG_BINARY)),
+                   (fs->enableWrite(), fs->deleteFile(0)));
+    BENCH_SCENARIO("insert-middle",
+                   populate(*fs, flags, BENCH_MIDDLE_FILE),
+                   (fs->enableWrite(), fs->writeFile(BENCH_MIDDLE_FILE, fileData, BENCH_FILE_SIZE, EEPROM_FILE_FLAG_BINARY)),
+                   (fs->enableWrite(), fs->deleteFile(BENCH_MIDDLE_FILE)));
+
+    // A few bytes added to the end of a file, which starts over once it got long
+    BENCH_SCENARIO("append",
+                   populate(*fs, flags, EEPROM_NO_FILE),
+                   (fs->enableWrite(), fs->appendToFile(BENCH_MIDDLE_FILE, fileData, BENCH_APPEND_SIZE)),
+                   ((fs->getActiveFiles().at(BENCH_MIDDLE_FILE) < 8 * BENCH_FILE_SIZE) ||
+                    (fs->enableWrite(), fs->writeFile(BENCH_MIDDLE_FILE, fileData, BENCH_FILE_SIZE, EEPROM_FILE_FLAG_BINARY))));
+
+    // Rewrite of a file in the middle with twice / half its size
+    BENCH_SCENARIO("grow",
+                   populate(*fs, flags, EEPROM_NO_FILE),
+                   (fs->enableWrite(), fs->writeFile(BENCH_MIDDLE_FILE, fileData, 2 * BENCH_FILE_SIZE, EEPROM_FILE_FLAG_BINARY)),
+                   (fs->enableWrite(), fs->writeFile(BENCH_MIDDLE_FILE, fileData, BENCH_FILE_SIZE, EEPROM_FILE_FLAG_BINARY)));
+    BENCH_SCENARIO("shrink",
+                   populate(*fs, flags, EEPROM_NO_FILE),
+                   (fs->enableWrite(), fs->writeFile(BENCH_MIDDLE_FILE, fileData, BENCH_FILE_SIZE / 2, EEPROM_FILE_FLAG_BINARY)),
+                   (fs->enableWrite(), fs->writeFile(BENCH_MIDDLE_FILE, fileData, BENCH_FILE_SIZE, EEPROM_FILE_FLAG_BINARY)));
+
+    // Removal of a file in the middle, written back afterwards
+    BENCH_SCENARIO("delete",
+                   populate(*fs, flags, EEPROM_NO_FILE),
+                   (fs->enableWrite(), fs->deleteFile(BENCH_MIDDLE_FILE)),
+                   (fs->enableWrite(), fs->writeFile(BENCH_MIDDLE_FILE, fileData, BENCH_FILE_SIZE, EEPROM_FILE_FLAG_BINARY)));
+
+    // Handle churn: open() and close() of a file nobody else holds
+    BENCH_SCENARIO("open-close",
+                   populate(*fs, flags, EEPROM_NO_FILE),
+                   ((NULL != fs->open(BENCH_MIDDLE_FILE)) && (fs->close(BENCH_MIDDLE_FILE), true)),
+                   true);
+
+    // Mount: loading and validating the populated image
+    BENCH_SCENARIO("mount",
+                   populate(*fs, flags, EEPROM_NO_FILE),
+                   (delete fs, fs = new EEPROMFS(&backend), EEPROMStatus::EEPROM_OK == fs->getStatus().value()),
+                   true);
+
+#undef BENCH_SCENARIO
+
+    delete fs;
+    return success;
+}
+
+int main ( int argc, char** argv )
+{
+    uint32_t iterations = (1 < argc) ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_ITERATIONS;
+    const char* imagePath = (2 < argc) ? argv[2] : "benchmark.bin";
+    const uint8_t layouts[] = { 0, EEPROM_FS_FLAG_LOG };
+    bool success = true;
+
+    if ( 0 == iterations )
+    {
+        fprintf(stderr, "usage: %s [iterations] [image file]\n", argv[0]);
+        return -1;
+    }
+    for ( uint32_t i = 0; i < sizeof(fileData); i++ )
+    {
+        fileData[i] = static_cast<uint8_t>(i);
+    }
+
+    // ops and bytes are averages per timed operation
+    printf("backend,layout,scenario,samples,p50_ns,p99_ns,max_ns,ops,bytes\n");
+    for ( uint32_t i = 0; i < sizeof(layouts); i++ )
+    {
+        EEPROMRamBackend ram(UNIX_FILE_SIZE);
+        EEPROMFileBackend file(imagePath, UNIX_FILE_SIZE);
+
+        success = runScenarios("ram", ram, layouts[i], iterations) && success;
+        success = runScenarios("file", file, layouts[i], iterations) && success;
+    }
+    remove(imagePath);
+
+    return success ? 0 : -1;
+}
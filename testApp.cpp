@@ -16,12 +16,84 @@
   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <atomic>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <cstdio>
 #include <cstring>
+#include <pthread.h>
+#include <unistd.h>
 #include "EEPROM_FS.h"
 #include "EEPROMStatus.h"
 
+// Backend simulating a power loss: after "budget" more program operations it stops
+//   programming anything, with the operation that hits the limit only half done
+class PowerCutBackend : public EEPROMBackend
+{
+public:
+    PowerCutBackend(EEPROMBackend& target) : target(target), budget(-1) {}
+
+    void cutAfter(int operations) { budget = operations; }
+    bool init() { return target.init(); }
+    uint32_t size() { return target.size(); }
+    bool read(uint8_t* buf, uint32_t address, uint32_t len) { return target.read(buf, address, len); }
+    bool program(const uint8_t* buf, uint32_t address, uint32_t len)
+    {
+        if ( 0 == budget )
+        {
+            budget = -2; // power is gone, later operations never reach the part
+            return ((len >> 3) << 2) ? target.program(buf, address, (len >> 3) << 2) : true;
+        }
+        if ( -2 == budget )
+        {
+            return true;
+        }
+        if ( 0 < budget )
+        {
+            budget--;
+        }
+        return target.program(buf, address, len);
+    }
+    bool massErase() { return target.massErase(); }
+
+private:
+    EEPROMBackend& target;
+    int budget;
+};
+
+// Backend counting the bytes programmed through it
+class CountingBackend : public EEPROMBackend
+{
+public:
+    CountingBackend(EEPROMBackend& target) : programmed(0), target(target) {}
+
+    bool init() { return target.init(); }
+    uint32_t size() { return target.size(); }
+    bool read(uint8_t* buf, uint32_t address, uint32_t len) { return target.read(buf, address, len); }
+    bool program(const uint8_t* buf, uint32_t address, uint32_t len)
+    {
+        programmed += len;
+        return target.program(buf, address, len);
+    }
+    bool massErase() { return target.massErase(); }
+
+    uint32_t programmed;
+
+private:
+    EEPROMBackend& target;
+};
+
+// Second reader for the read lock test: takes the read lock while the main thread holds it
+static std::atomic<bool> sharedReaderDone(false);
+static void* sharedReader(void* fs)
+{
+    static_cast<EEPROMFS*>(fs)->getReadLock();
+    sharedReaderDone = true;
+    static_cast<EEPROMFS*>(fs)->releaseReadLock();
+    return NULL;
+}
+
 int main ( void )
 {
     EEPROMFS hEeprom;
@@ -260,7 +332,7 @@ int main ( void )
     // Now we'll try and write a eleventh file, this time it will be huge and not at the end AND it will be ONE byte too long (NULL terminator pushes it over)
     std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
     std::cout << "--> Eleventh File Insertion Test - BAD New file at Index 10 (ONE byte too long) <--" << std::endl;
-    char msg11[] = "Contrary to popular belief, Lorem Ipsum is not simply random text. It has roots in a piece of classical Latin literature from 45 BC,"
+    char loremIpsum[] = "Contrary to popular belief, Lorem Ipsum is not simply random text. It has roots in a piece of classical Latin literature from 45 BC,"
                    " making it over 2000 years old. Richard McClintock, a Latin professor at Hampden-Sydney College in Virginia, looked up one of the more"
                    " obscure Latin words, consectetur, from a Lorem Ipsum passage, and going through the cites of the word in classical literature, discovered"
                    " the undoubtable source. Lorem Ipsum comes from sections 1.10.32 and 1.10.33 of \"de Finibus Bonorum et Malorum\" (The Extremes of Good and"
@@ -277,9 +349,24 @@ int main ( void )
                    " ipsum' will uncover many web sites still in their infancy. Various versions have evolved over the years, sometimes by accident, sometimes on"
                    " purpose (injected humour and the like).FEDCBA";
 
-    std::cout << "Writing a file with " << strlen(msg11) + 1 << " bytes into index 10" << std::endl;
+    // Size the file from the space that is left so it comes out exactly ONE byte too long
+    //   (any existing file at index 10 is replaced, so its space counts as free)
+    uint32_t freeBytes = hEeprom.getTotalCapacity() - hEeprom.getUsedCapacity();
+    std::map<fileId_t, eepromAddr_t> existingFiles = hEeprom.getActiveFiles();
+    if ( existingFiles.find(10) != existingFiles.end() )
+    {
+        freeBytes += existingFiles[10];
+    }
+    if ( strlen(loremIpsum) < freeBytes )
+    {
+        std::cout << "ERROR: test text is too short to fill the " << freeBytes << " free bytes" << std::endl;
+        return -1;
+    }
+    std::string msg11(loremIpsum, freeBytes);
+
+    std::cout << "Writing a file with " << msg11.size() + 1 << " bytes into index 10" << std::endl;
     hEeprom.enableWrite();
-    if ( hEeprom.writeFile(10, (uint8_t*)msg11, static_cast<uint16_t>(strlen(msg11)) + 1) ) // capture that NULL character
+    if ( hEeprom.writeFile(10, (uint8_t*)msg11.c_str(), static_cast<uint16_t>(msg11.size()) + 1) ) // capture that NULL character
     {
         std::cout << "ERROR: writeFile Did NOT return an error like it should have upon a bad file length attempt" << std::endl;
         std::cout << "INFO: EEPROM state: " << hEeprom.getStatus().c_str() << std::endl;
@@ -300,26 +387,12 @@ int main ( void )
     // Now we'll try and write a twelfth file, this time it will be huge and not at the end but JUST fit in, maxing out file system
     std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
     std::cout << "--> Twelfth File Insertion Test - New file at Index 10 <--" << std::endl;
-    char msg12[] = "Contrary to popular belief, Lorem Ipsum is not simply random text. It has roots in a piece of classical Latin literature from 45 BC,"
-                   " making it over 2000 years old. Richard McClintock, a Latin professor at Hampden-Sydney College in Virginia, looked up one of the more"
-                   " obscure Latin words, consectetur, from a Lorem Ipsum passage, and going through the cites of the word in classical literature, discovered"
-                   " the undoubtable source. Lorem Ipsum comes from sections 1.10.32 and 1.10.33 of \"de Finibus Bonorum et Malorum\" (The Extremes of Good and"
-                   " Evil) by Cicero, written in 45 BC. This book is a treatise on the theory of ethics, very popular during the Renaissance. The first line of"
-                   " Lorem Ipsum \"Lorem ipsum dolor sit\".\n"
-                   "Lorem Ipsum is simply dummy text of the printing and typesetting industry. Lorem Ipsum has been the industry's standard dummy text ever since"
-                   " the 1500s, when an unknown printer took a galley of type and scrambled it to make a type specimen book. It has survived not only five"
-                   " centuries, but also the leap into electronic typesetting, remaining essentially unchanged. It was popularised in the 1960s with the release"
-                   " of Letraset sheets containing Lorem Ipsum passages, and more recently with desktop publishing software like Aldus PageMaker including versions"
-                   " of Lorem Ipsum.\n"
-                   "It is a long established fact that a reader will be distracted by the readable content of a page when looking at its layout. The point of using"
-                   " Lorem Ipsum is that it has a more-or-less normal distribution of letters, as opposed to using 'Content here, content here', making it look like"
-                   " readable English. Many desktop publishing packages and web page editors now use Lorem Ipsum as their default model text, and a search for 'lorem"
-                   " ipsum' will uncover many web sites still in their infancy. Various versions have evolved over the years, sometimes by accident, sometimes on"
-                   " purpose (injected humour and the like).EDCBA";
+    // Same text, one character shorter than the failed attempt so it exactly fills the space left
+    std::string msg12(loremIpsum, freeBytes - 1);
 
-    std::cout << "Writing a file with " << strlen(msg12) + 1 << " bytes into index 10" << std::endl;
+    std::cout << "Writing a file with " << msg12.size() + 1 << " bytes into index 10" << std::endl;
     hEeprom.enableWrite();
-    if ( !hEeprom.writeFile(10, (uint8_t*)msg12, static_cast<uint16_t>(strlen(msg12)) + 1) ) // capture that NULL character
+    if ( !hEeprom.writeFile(10, (uint8_t*)msg12.c_str(), static_cast<uint16_t>(msg12.size()) + 1) ) // capture that NULL character
     {
         std::cout << "ERROR: writeFile returned an error during our write attempt" << std::endl;
         std::cout << "INFO: EEPROM state: " << hEeprom.getStatus().c_str() << std::endl;
@@ -408,14 +481,14 @@ int main ( void )
     }
 
     // Be a good person and lock the system whilst accessing data
-    hEeprom.getLock();
+    hEeprom.getReadLock();
 
     // Verify size
     if ( hFile->size != (strlen("Leif is a cat") + 1) )
     {
         std::cout << "ERROR: file handle returned unexpected length: " << hFile->size << ". Expecting " << (strlen("Leif is a cat") + 1) << std::endl;
         std::cout << "INFO: EEPROM state: " << hEeprom.getStatus().c_str() << std::endl;
-        hEeprom.releaseLock();
+        hEeprom.releaseReadLock();
         hEeprom.close(1);
         return -1;
     }
@@ -425,7 +498,7 @@ int main ( void )
     {
         std::cout << "ERROR: file handle returned NULL data pointer" << std::endl;
         std::cout << "INFO: EEPROM state: " << hEeprom.getStatus().c_str() << std::endl;
-        hEeprom.releaseLock();
+        hEeprom.releaseReadLock();
         hEeprom.close(1);
         return -1;
     }
@@ -434,7 +507,7 @@ int main ( void )
     std::cout << "INFO: open file test for index 1 (Leif is a cat): data-> \"" << hFile->data << "\"" << std::endl;
 
     // Be a good person and release assets
-    hEeprom.releaseLock();
+    hEeprom.releaseReadLock();
 
     /***************************************************************************************************************************/
     std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
@@ -465,14 +538,14 @@ int main ( void )
     }
 
     // Be a good person and lock the system whilst accessing data
-    hEeprom.getLock();
+    hEeprom.getReadLock();
 
     // Verify size
     if ( hFile->size != (strlen("Leif is a cat") + 1) )
     {
         std::cout << "ERROR: file handle returned unexpected length: " << hFile->size << ". Expecting " << (strlen("Leif is a cat") + 1) << std::endl;
         std::cout << "INFO: EEPROM state: " << hEeprom.getStatus().c_str() << std::endl;
-        hEeprom.releaseLock();
+        hEeprom.releaseReadLock();
         hEeprom.close(1);
         return -1;
     }
@@ -482,7 +555,7 @@ int main ( void )
     {
         std::cout << "ERROR: file handle returned NULL data pointer" << std::endl;
         std::cout << "INFO: EEPROM state: " << hEeprom.getStatus().c_str() << std::endl;
-        hEeprom.releaseLock();
+        hEeprom.releaseReadLock();
         hEeprom.close(1);
         return -1;
     }
@@ -491,25 +564,994 @@ int main ( void )
     std::cout << "INFO: open file test for index 1 (Leif is a cat): data-> \"" << hFile->data << "\"" << std::endl;
 
     // Be a good person and release assets
-    hEeprom.releaseLock();
+    hEeprom.releaseReadLock();
     hEeprom.close(1);
 
     /***************************************************************************************************************************/
     std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
     std::cout << "--> Verify getActiveFiles() <--" << std::endl;
-    std::map<uint8_t, uint16_t> fileMap = hEeprom.getActiveFiles();
+    std::map<fileId_t, eepromAddr_t> fileMap = hEeprom.getActiveFiles();
 
     // Create a map iterator and point to beginning of map
-    std::map<uint8_t, uint16_t>::iterator mit = fileMap.begin();
+    std::map<fileId_t, eepromAddr_t>::iterator mit = fileMap.begin();
     // Iterate over the map using Iterator till end.
-    for (std::map<uint8_t, uint16_t>::iterator mit = fileMap.begin(); mit != fileMap.end(); mit++)
+    for (std::map<fileId_t, eepromAddr_t>::iterator mit = fileMap.begin(); mit != fileMap.end(); mit++)
     {
         // Accessing KEY from element pointed by it.
-        uint8_t fileId = mit->first;
+        fileId_t fileId = mit->first;
         // Accessing VALUE from element pointed by it.
-        uint16_t size = mit->second;
+        eepromAddr_t size = mit->second;
         std::cout << "FileId: " << unsigned(fileId) << ", size: " << size << std::endl;
     }
 
+    /***************************************************************************************************************************/
+    std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
+    std::cout << "--> Odd Size Test - a backend size that is not whole words <--" << std::endl;
+    {
+        EEPROMRamBackend oddBackend(UNIX_FILE_SIZE + 2);
+        EEPROMFS oddEeprom(&oddBackend);
+        uint8_t tail[2] = { 0x12, 0x34 };
+
+        // The backend still holds every byte, the file system refuses the image
+        if ( !oddBackend.program(tail, UNIX_FILE_SIZE, sizeof(tail)) ||
+             !oddBackend.read(tail, UNIX_FILE_SIZE, sizeof(tail)) || (0x12 != tail[0]) || (0x34 != tail[1]) )
+        {
+            std::cout << "ERROR: RAM backend lost the bytes past the last whole word" << std::endl;
+            return -1;
+        }
+        if ( oddEeprom.getStatus().value() != EEPROMStatus::EEPROM_ERROR_BAD_PARAMS )
+        {
+            std::cout << "ERROR: image size that is not whole words was accepted" << std::endl;
+            std::cout << "INFO: EEPROM state: " << oddEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: odd size image refused: " << oddEeprom.getStatus().c_str() << std::endl;
+    }
+
+    /***************************************************************************************************************************/
+    std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
+    std::cout << "--> Image Size Limit Test - every address of the image fits the on-media format <--" << std::endl;
+#if !defined(EEPROM_FS_WIDE_ADDRESSES)
+    {
+        EEPROMRamBackend limitBackend(EEPROM_MAX_IMAGE_SIZE + 4);
+        {
+            EEPROMFS tooBig(&limitBackend);
+
+            if ( tooBig.getStatus().value() != EEPROMStatus::EEPROM_ERROR_BAD_PARAMS )
+            {
+                std::cout << "ERROR: image one word over the address range was accepted" << std::endl;
+                std::cout << "INFO: EEPROM state: " << tooBig.getStatus().c_str() << std::endl;
+                return -1;
+            }
+        }
+        {
+            // Fill the largest image, then put an empty file at its very end
+            EEPROMFS largest(&limitBackend, EEPROM_MAX_IMAGE_SIZE);
+            std::vector<uint8_t> big;
+            uint8_t b = 0;
+
+            largest.enableWrite();
+            if ( !largest.format(4) )
+            {
+                std::cout << "ERROR: largest image did not format" << std::endl;
+                std::cout << "INFO: EEPROM state: " << largest.getStatus().c_str() << std::endl;
+                return -1;
+            }
+            big.assign(largest.getTotalCapacity() - largest.getUsedCapacity(), 0x5A);
+            largest.enableWrite();
+            largest.writeFile(0, big.data(), static_cast<uint32_t>(big.size()), EEPROM_FILE_FLAG_BINARY);
+            largest.enableWrite();
+            if ( !largest.writeFile(1, &b, 0) )
+            {
+                std::cout << "ERROR: empty file at the end of the largest image was refused" << std::endl;
+                std::cout << "INFO: EEPROM state: " << largest.getStatus().c_str() << std::endl;
+                return -1;
+            }
+        }
+        // The end of the image is a start address too, so the largest image is one word
+        //   short of the address range
+        EEPROMFS largest(&limitBackend, EEPROM_MAX_IMAGE_SIZE);
+        if ( (largest.getStatus().value() != EEPROMStatus::EEPROM_OK) || largest.isQuarantined(0) ||
+             (2 != largest.getActiveFileCount()) )
+        {
+            std::cout << "ERROR: largest image loses the empty file at its end on remount" << std::endl;
+            std::cout << "INFO: EEPROM state: " << largest.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: largest image: " << largest.getTotalCapacity() << " bytes" << std::endl;
+    }
+#endif
+
+    /***************************************************************************************************************************/
+    std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
+    std::cout << "--> Log-Structured Mode Test - repeated config saves on a RAM backed image <--" << std::endl;
+    EEPROMRamBackend logBackend(UNIX_FILE_SIZE);
+    {
+        EEPROMFS logEeprom(&logBackend);
+        char config[32];
+
+        logEeprom.enableWrite();
+        if ( !logEeprom.format(EEPROM_DEFAULT_NUM_FILES, EEPROM_FS_FLAG_LOG) )
+        {
+            std::cout << "ERROR: log-structured format failed" << std::endl;
+            std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        // Enough saves to wrap the log head around the image several times
+        for ( int i = 0; i < 200; i++ )
+        {
+            snprintf(config, sizeof(config), "config save %d", i);
+            logEeprom.enableWrite();
+            if ( !logEeprom.writeFile(3, (uint8_t*)config, static_cast<uint32_t>(strlen(config)) + 1) )
+            {
+                std::cout << "ERROR: writeFile returned an error during save " << i << std::endl;
+                std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+                return -1;
+            }
+        }
+        logEeprom.enableWrite();
+        logEeprom.collectGarbage();
+        std::cout << "Log-structured usage: " << logEeprom.getUsedCapacity() << " out of " << logEeprom.getTotalCapacity() << " bytes" << std::endl;
+    }
+    {
+        // Mount the same image again, the newest table slot has to win
+        EEPROMFS logEeprom(&logBackend);
+        handle_t* hLog = logEeprom.open(3);
+
+        if ( (NULL == hLog) || (0 != strcmp((char*)hLog->data, "config save 199")) )
+        {
+            std::cout << "ERROR: remounted log-structured image does not hold the last save" << std::endl;
+            std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: remounted log-structured file 3: data-> \"" << hLog->data << "\"" << std::endl;
+        logEeprom.close(3);
+    }
+    {
+        // An empty file shares its start address with the next file written to the log
+        EEPROMRamBackend emptyBackend(UNIX_FILE_SIZE);
+        {
+            EEPROMFS logEeprom(&emptyBackend);
+            uint8_t b = 0;
+
+            logEeprom.enableWrite();
+            logEeprom.format(4, EEPROM_FS_FLAG_LOG);
+            logEeprom.enableWrite();
+            logEeprom.writeFile(2, &b, 0);
+            logEeprom.enableWrite();
+            logEeprom.writeFile(1, (uint8_t*)"abc", 3);
+        }
+        EEPROMFS logEeprom(&emptyBackend);
+        if ( logEeprom.getStatus().value() != EEPROMStatus::EEPROM_OK )
+        {
+            std::cout << "ERROR: log-structured image with an empty file does not mount" << std::endl;
+            std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+    }
+
+    /***************************************************************************************************************************/
+    std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
+    std::cout << "--> Power Loss Test - an interrupted writeFile is rolled back <--" << std::endl;
+    PowerCutBackend cutBackend(logBackend);
+    for ( int cut = 0; cut < 3; cut++ )
+    {
+        {
+            EEPROMFS logEeprom(&cutBackend);
+            char update[] = "config lost to power failure";
+
+            // Power fails after the file data, during the table, or right before the commit word
+            cutBackend.cutAfter(cut);
+            logEeprom.enableWrite();
+            logEeprom.writeFile(3, (uint8_t*)update, static_cast<uint32_t>(strlen(update)) + 1);
+            cutBackend.cutAfter(-1);
+        }
+
+        EEPROMFS logEeprom(&cutBackend);
+        handle_t* hLog = logEeprom.open(3);
+        if ( (NULL == hLog) || (0 != strcmp((char*)hLog->data, "config save 199")) )
+        {
+            std::cout << "ERROR: interrupted write after " << cut << " program operations was not rolled back" << std::endl;
+            std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        logEeprom.close(3);
+    }
+    std::cout << "INFO: file 3 still holds the last complete save after every interrupted write" << std::endl;
+    {
+        // Packed images put the new version into the gap next to the committed one when it fits
+        EEPROMRamBackend packedRam(UNIX_FILE_SIZE);
+        PowerCutBackend packedCut(packedRam);
+        char saved[] = "packed config 1";
+        char update[] = "packed config 2";
+        {
+            EEPROMFS packedEeprom(&packedCut);
+
+            packedEeprom.enableWrite();
+            packedEeprom.format();
+            packedEeprom.enableWrite();
+            packedEeprom.writeFile(2, (uint8_t*)"neighbour", 10);
+            packedEeprom.enableWrite();
+            packedEeprom.writeFile(3, (uint8_t*)saved, sizeof(saved));
+        }
+        // Power fails after the new copy, during the table, or right before the commit word;
+        //   the rewrite and the partial write both leave the committed copy alone
+        for ( int cut = 0; cut < 6; cut++ )
+        {
+            {
+                EEPROMFS packedEeprom(&packedCut);
+
+                packedCut.cutAfter(cut % 3);
+                packedEeprom.enableWrite();
+                if ( cut < 3 )
+                {
+                    packedEeprom.writeFile(3, (uint8_t*)update, sizeof(update));
+                }
+                else
+                {
+                    packedEeprom.writeFileAt(3, 14, (uint8_t*)"2", 1);
+                }
+                packedCut.cutAfter(-1);
+            }
+
+            EEPROMFS packedEeprom(&packedCut);
+            handle_t* hPacked = packedEeprom.open(3);
+            if ( (NULL == hPacked) || (0 != strcmp((char*)hPacked->data, saved)) )
+            {
+                std::cout << "ERROR: interrupted packed " << ((cut < 3) ? "rewrite" : "partial write") << " after "
+                          << (cut % 3) << " program operations was not rolled back" << std::endl;
+                std::cout << "INFO: EEPROM state: " << packedEeprom.getStatus().c_str() << std::endl;
+                return -1;
+            }
+            packedEeprom.close(3);
+        }
+        {
+            // Once the commit word is in, the update stands even if erasing the old copy is cut short
+            EEPROMFS packedEeprom(&packedCut);
+
+            packedCut.cutAfter(3);
+            packedEeprom.enableWrite();
+            packedEeprom.writeFile(3, (uint8_t*)update, sizeof(update));
+            packedCut.cutAfter(-1);
+        }
+        EEPROMFS packedEeprom(&packedCut);
+        handle_t* hPacked = packedEeprom.open(3);
+        if ( (NULL == hPacked) || (0 != strcmp((char*)hPacked->data, update)) || (0 != packedEeprom.getQuarantinedFileCount()) )
+        {
+            std::cout << "ERROR: packed rewrite cut short while erasing the old copy was lost" << std::endl;
+            std::cout << "INFO: EEPROM state: " << packedEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        packedEeprom.close(3);
+        std::cout << "INFO: packed file 3 rolled back after every interrupted rewrite" << std::endl;
+    }
+
+    /***************************************************************************************************************************/
+    std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
+    std::cout << "--> Quarantine Test - a damaged file does not take the file system down with it <--" << std::endl;
+    {
+        EEPROMFS logEeprom(&logBackend);
+        char victim[] = "calibration record to be damaged";
+
+        logEeprom.enableWrite();
+        if ( !logEeprom.writeFile(5, (uint8_t*)victim, static_cast<uint32_t>(strlen(victim)) + 1) )
+        {
+            std::cout << "ERROR: writeFile returned an error during our write attempt" << std::endl;
+            std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+    }
+    {
+        // Flip one bit of the file behind the file system's back
+        std::vector<uint8_t> image(logBackend.size());
+        logBackend.read(image.data(), 0, logBackend.size());
+        std::string raw(image.begin(), image.end());
+        size_t damage = raw.find("calibration record");
+        image[damage] ^= 0x01;
+        logBackend.program(image.data(), 0, logBackend.size());
+    }
+    {
+        EEPROMFS logEeprom(&logBackend);
+
+        if ( (logEeprom.getStatus().value() != EEPROMStatus::EEPROM_OK) ||
+             (1 != logEeprom.getQuarantinedFileCount()) || !logEeprom.isQuarantined(5) )
+        {
+            std::cout << "ERROR: damaged file 5 was not quarantined" << std::endl;
+            std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        if ( (NULL != logEeprom.open(5)) || (logEeprom.getStatus().value() != EEPROMStatus::EEPROM_ERROR_CORRUPTED_FILE) )
+        {
+            std::cout << "ERROR: open() handed out quarantined file 5" << std::endl;
+            return -1;
+        }
+        handle_t* hLog = logEeprom.open(3);
+        if ( (NULL == hLog) || (0 != strcmp((char*)hLog->data, "config save 199")) )
+        {
+            std::cout << "ERROR: file 3 did not survive the damage to file 5" << std::endl;
+            std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        logEeprom.close(3);
+
+        // Deleting the damaged file lifts the quarantine
+        logEeprom.enableWrite();
+        if ( !logEeprom.deleteFile(5) || (0 != logEeprom.getQuarantinedFileCount()) )
+        {
+            std::cout << "ERROR: deleting quarantined file 5 failed" << std::endl;
+            std::cout << "INFO: EEPROM state: " << logEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: file 5 was quarantined and removed, file 3 is intact" << std::endl;
+    }
+
+    /***************************************************************************************************************************/
+    std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
+    std::cout << "--> Content Check Test - text may hold tabs and line breaks, but no other control characters <--" << std::endl;
+    {
+        EEPROMFS logEeprom(&logBackend);
+        char script[] = "line one\n\tline two\r\n";
+        char bell[] = "ring the \a bell";
+        char hidden[] = "visible\0hidden";
+
+        logEeprom.enableWrite();
+        logEeprom.writeFile(6, (uint8_t*)script, static_cast<uint32_t>(strlen(script)) + 1);
+
+        // Content the next mount would quarantine is refused up front, the status tells
+        //   where the first offending byte is
+        logEeprom.enableWrite();
+        if ( logEeprom.writeFile(7, (uint8_t*)bell, static_cast<uint32_t>(strlen(bell)) + 1) ||
+             (logEeprom.getStatus().value() != EEPROMStatus::EEPROM_ERROR_NON_ASCII) ||
+             (9 != logEeprom.getStatus().offset()) )
+        {
+            std::cout << "ERROR: writeFile accepted a BEL character in a text file" << std::endl;
+            return -1;
+        }
+        logEeprom.enableWrite();
+        if ( logEeprom.writeFile(7, (uint8_t*)hidden, sizeof(hidden)) ||
+             (logEeprom.getStatus().value() != EEPROMStatus::EEPROM_ERROR_UNEXPECTED_NULLS) ||
+             (8 != logEeprom.getStatus().offset()) )
+        {
+            std::cout << "ERROR: writeFile accepted text after a NUL" << std::endl;
+            return -1;
+        }
+        // Partial writes are checked the same way
+        logEeprom.enableWrite();
+        if ( logEeprom.writeFileAt(6, static_cast<uint32_t>(strlen(script)), (uint8_t*)"\a", 1) )
+        {
+            std::cout << "ERROR: writeFileAt put a BEL character into a text file" << std::endl;
+            return -1;
+        }
+    }
+    {
+        EEPROMFS logEeprom(&logBackend);
+
+        if ( logEeprom.isQuarantined(6) || (0 != logEeprom.getQuarantinedFileCount()) ||
+             (logEeprom.getActiveFiles().count(7)) )
+        {
+            std::cout << "ERROR: content check let a bad text file through" << std::endl;
+            return -1;
+        }
+        logEeprom.enableWrite();
+        logEeprom.deleteFile(6);
+        std::cout << "INFO: multi-line file 6 accepted, file 7 with a BEL character refused" << std::endl;
+    }
+
+    /***************************************************************************************************************************/
+    std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
+    std::cout << "--> Binary File Test - raw calibration data survives a remount unchanged <--" << std::endl;
+    EEPROMRamBackend binBackend(UNIX_FILE_SIZE);
+    uint8_t calibration[256];
+    for ( int i = 0; i < 256; i++ )
+    {
+        calibration[i] = static_cast<uint8_t>(255 - i); // every byte value, NULs included
+    }
+    {
+        EEPROMFS binEeprom(&binBackend);
+
+        binEeprom.enableWrite();
+        binEeprom.format();
+        binEeprom.enableWrite();
+        if ( !binEeprom.writeFile(4, calibration, sizeof(calibration), EEPROM_FILE_FLAG_BINARY) )
+        {
+            std::cout << "ERROR: writeFile returned an error during our binary write attempt" << std::endl;
+            std::cout << "INFO: EEPROM state: " << binEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+    }
+    {
+        EEPROMFS binEeprom(&binBackend);
+        handle_t* hBin = binEeprom.open(4);
+
+        if ( (NULL == hBin) || (sizeof(calibration) != hBin->size) ||
+             (0 == (hBin->flags & EEPROM_FILE_FLAG_BINARY)) ||
+             (0 != memcmp(hBin->data, calibration, sizeof(calibration))) )
+        {
+            std::cout << "ERROR: binary file 4 did not come back unchanged" << std::endl;
+            std::cout << "INFO: EEPROM state: " << binEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        binEeprom.close(4);
+        std::cout << "INFO: binary file 4 read back " << sizeof(calibration) << " bytes in place" << std::endl;
+    }
+
+    std::cout << std::endl;
+    std::cout << "--> Transaction Test - several writes and a delete land together <--" << std::endl;
+    EEPROMRamBackend txBackend(UNIX_FILE_SIZE);
+    {
+        EEPROMFS txEeprom(&txBackend);
+        EEPROMTransaction transaction;
+        char netConfig[] = "ip=10.0.0.2";
+        char netConfigNew[] = "ip=10.0.0.7 mask=255.255.255.0";
+        char motorConfig[] = "rpm=1200";
+        char logConfig[] = "level=debug";
+
+        txEeprom.enableWrite();
+        txEeprom.format();
+        txEeprom.enableWrite();
+        txEeprom.writeFile(1, (uint8_t*)netConfig, sizeof(netConfig));
+        txEeprom.enableWrite();
+        txEeprom.writeFile(2, (uint8_t*)motorConfig, sizeof(motorConfig));
+
+        // deleting a file that does not exist must fail the whole batch
+        transaction.writeFile(1, (uint8_t*)netConfigNew, sizeof(netConfigNew));
+        transaction.deleteFile(9);
+        txEeprom.enableWrite();
+        if ( txEeprom.commit(transaction) || (2 != transaction.getOperationCount()) )
+        {
+            std::cout << "ERROR: commit accepted a transaction deleting a missing file" << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: bad transaction refused: " << txEeprom.getStatus().c_str() << std::endl;
+
+        transaction.clear();
+        transaction.writeFile(1, (uint8_t*)netConfigNew, sizeof(netConfigNew));
+        transaction.deleteFile(2);
+        transaction.writeFile(5, (uint8_t*)logConfig, sizeof(logConfig));
+        txEeprom.enableWrite();
+        if ( !txEeprom.commit(transaction) || (0 != transaction.getOperationCount()) )
+        {
+            std::cout << "ERROR: commit returned an error for a valid transaction" << std::endl;
+            std::cout << "INFO: EEPROM state: " << txEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+    }
+    {
+        EEPROMFS txEeprom(&txBackend);
+        handle_t* hNet = txEeprom.open(1);
+        handle_t* hLog = txEeprom.open(5);
+
+        if ( (2 != txEeprom.getActiveFileCount()) || (NULL == hNet) || (NULL == hLog) ||
+             (0 != strcmp((char*)hNet->data, "ip=10.0.0.7 mask=255.255.255.0")) ||
+             (0 != strcmp((char*)hLog->data, "level=debug")) || (NULL != txEeprom.open(2)) )
+        {
+            std::cout << "ERROR: transaction results did not survive a remount" << std::endl;
+            std::cout << "INFO: EEPROM state: " << txEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        txEeprom.close(1);
+        txEeprom.close(5);
+        std::cout << "INFO: files 1 and 5 updated, file 2 deleted in one commit" << std::endl;
+    }
+
+    std::cout << std::endl;
+    std::cout << "--> Slack Test - a growing status file does not drag its neighbours along <--" << std::endl;
+    EEPROMRamBackend slackBackend(UNIX_FILE_SIZE);
+    {
+        EEPROMFS slackEeprom(&slackBackend);
+        char status[] = "ok";
+        char statusLong[] = "ok uptime=123456 errors=0 last=none";
+        char settings[] = "baud=115200";
+
+        slackEeprom.enableWrite();
+        slackEeprom.format(EEPROM_DEFAULT_NUM_FILES, 0, 0, 64);
+        slackEeprom.enableWrite();
+        slackEeprom.writeFile(0, (uint8_t*)status, sizeof(status));
+        slackEeprom.enableWrite();
+        slackEeprom.writeFile(1, (uint8_t*)settings, sizeof(settings));
+
+        handle_t* hSettings = slackEeprom.open(1);
+        uint8_t* settingsData = hSettings->data;
+
+        slackEeprom.enableWrite();
+        if ( !slackEeprom.writeFile(0, (uint8_t*)statusLong, sizeof(statusLong)) )
+        {
+            std::cout << "ERROR: writeFile returned an error growing file 0" << std::endl;
+            std::cout << "INFO: EEPROM state: " << slackEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        if ( (settingsData != hSettings->data) || (0 != strcmp((char*)hSettings->data, settings)) )
+        {
+            std::cout << "ERROR: growing file 0 moved file 1 despite the headroom behind it" << std::endl;
+            return -1;
+        }
+        slackEeprom.close(1);
+        std::cout << "INFO: file 0 grew from " << sizeof(status) << " to " << sizeof(statusLong)
+                  << " bytes in place, file 1 stayed put" << std::endl;
+    }
+
+    std::cout << std::endl;
+    std::cout << "--> Read Lock Test - two readers hold the lock at the same time <--" << std::endl;
+    {
+        pthread_t reader;
+        bool overlapped;
+
+        hEeprom.getReadLock();
+        pthread_create(&reader, NULL, sharedReader, &hEeprom);
+        // an exclusive lock would keep the second reader waiting until we let go
+        for ( int i = 0; (i < 1000) && !sharedReaderDone; i++ )
+        {
+            usleep(1000);
+        }
+        overlapped = sharedReaderDone;
+        hEeprom.releaseReadLock();
+        pthread_join(reader, NULL);
+        if ( !overlapped )
+        {
+            std::cout << "ERROR: second reader was blocked by the first" << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: second reader got in while the first held the read lock" << std::endl;
+    }
+
+#if defined(EEPROM_FS_SNAPSHOTS)
+    std::cout << std::endl;
+    std::cout << "--> Snapshot Test - a pinned snapshot is unaffected by later writes <--" << std::endl;
+    {
+        EEPROMRamBackend snapBackend(UNIX_FILE_SIZE);
+        EEPROMFS snapEeprom(&snapBackend);
+        char before[] = "mode=auto";
+        char after[] = "mode=manual override=1";
+        const EEPROMSnapshot* snapshot;
+        const EEPROMSnapshot* newer;
+
+        snapEeprom.enableWrite();
+        snapEeprom.format();
+        snapEeprom.enableWrite();
+        snapEeprom.writeFile(2, (uint8_t*)before, sizeof(before));
+
+        snapshot = snapEeprom.acquireSnapshot();
+        snapEeprom.enableWrite();
+        snapEeprom.writeFile(2, (uint8_t*)after, sizeof(after));
+        newer = snapEeprom.acquireSnapshot();
+
+        if ( (NULL == snapshot) || (NULL == newer) ||
+             (sizeof(before) != snapshot->getSize(2)) || (0 != strcmp((const char*)snapshot->getData(2), before)) ||
+             (sizeof(after) != newer->getSize(2)) || (0 != strcmp((const char*)newer->getData(2), after)) )
+        {
+            std::cout << "ERROR: snapshots did not keep their own version of file 2" << std::endl;
+            return -1;
+        }
+        snapEeprom.releaseSnapshot(snapshot);
+        snapEeprom.releaseSnapshot(newer);
+        std::cout << "INFO: old snapshot still read \"" << before << "\" after file 2 was rewritten" << std::endl;
+
+        // The pool does not grow: with every snapshot held there is none to publish an update in
+        const EEPROMSnapshot* held[EEPROM_SNAPSHOT_POOL_SIZE];
+        for ( int i = 0; i < EEPROM_SNAPSHOT_POOL_SIZE; i++ )
+        {
+            held[i] = snapEeprom.acquireSnapshot();
+            snapEeprom.enableWrite();
+            snapEeprom.writeFile(2, (uint8_t*)before, sizeof(before));
+        }
+        if ( NULL != snapEeprom.acquireSnapshot() )
+        {
+            std::cout << "ERROR: snapshot handed out although readers held the whole pool" << std::endl;
+            return -1;
+        }
+        snapEeprom.releaseSnapshot(held[0]);
+        snapEeprom.enableWrite();
+        snapEeprom.writeFile(2, (uint8_t*)after, sizeof(after));
+        snapshot = snapEeprom.acquireSnapshot();
+        if ( (NULL == snapshot) || (0 != strcmp((const char*)snapshot->getData(2), after)) )
+        {
+            std::cout << "ERROR: no snapshot published once one was released again" << std::endl;
+            return -1;
+        }
+        snapEeprom.releaseSnapshot(snapshot);
+        for ( int i = 1; i < EEPROM_SNAPSHOT_POOL_SIZE; i++ )
+        {
+            snapEeprom.releaseSnapshot(held[i]);
+        }
+    }
+#endif
+
+    std::cout << std::endl;
+    std::cout << "--> Read View Test - scoped zero-copy access without lock calls <--" << std::endl;
+    {
+        EEPROMRamBackend viewBackend(UNIX_FILE_SIZE);
+        EEPROMFS viewEeprom(&viewBackend);
+        char pinned[] = "threshold=42";
+
+        viewEeprom.enableWrite();
+        viewEeprom.format();
+        viewEeprom.enableWrite();
+        viewEeprom.writeFile(3, (uint8_t*)pinned, sizeof(pinned));
+        {
+            EEPROMReadView view(viewEeprom, 3);
+            EEPROMReadView missing(viewEeprom, 4);
+
+            if ( !view.isValid() || (sizeof(pinned) != view.getSize()) ||
+                 (0 != strcmp((const char*)view.getData(), pinned)) || missing.isValid() )
+            {
+                std::cout << "ERROR: read view did not return file 3 (or returned missing file 4)" << std::endl;
+                return -1;
+            }
+            std::cout << "INFO: view of file 3 reads \"" << (const char*)view.getData() << "\" in place" << std::endl;
+        }
+        // the views released their pins when they went out of scope, writers can get in again
+        viewEeprom.enableWrite();
+        if ( !viewEeprom.deleteFile(3) )
+        {
+            std::cout << "ERROR: deleteFile failed after the read views were released" << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << std::endl;
+    std::cout << "--> Partial Write Test - with no room for a copy, bumping a counter programs only a few bytes <--" << std::endl;
+    EEPROMRamBackend partialRam(UNIX_FILE_SIZE);
+    CountingBackend partialBackend(partialRam);
+    {
+        EEPROMFS partialEeprom(&partialBackend);
+        uint8_t record[200];
+        uint32_t counter = 0x01020304;
+        uint32_t readBack = 0;
+
+        std::memset(record, 0xA5, sizeof(record));
+        partialEeprom.enableWrite();
+        partialEeprom.format();
+        partialEeprom.enableWrite();
+        partialEeprom.writeFile(6, record, sizeof(record), EEPROM_FILE_FLAG_BINARY);
+        {
+            // A patched copy goes next to the file whenever it fits, so take all the room away
+            std::vector<uint8_t> filler(partialEeprom.getTotalCapacity() - partialEeprom.getUsedCapacity(), 0x5A);
+
+            partialEeprom.enableWrite();
+            partialEeprom.writeFile(7, filler.data(), static_cast<uint32_t>(filler.size()), EEPROM_FILE_FLAG_BINARY);
+        }
+
+        partialBackend.programmed = 0;
+        partialEeprom.enableWrite();
+        if ( !partialEeprom.writeFileAt(6, 100, (uint8_t*)&counter, sizeof(counter)) )
+        {
+            std::cout << "ERROR: writeFileAt returned an error" << std::endl;
+            std::cout << "INFO: EEPROM state: " << partialEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        if ( (sizeof(counter) != partialEeprom.readFileAt(6, 100, (uint8_t*)&readBack, sizeof(readBack))) ||
+             (counter != readBack) || (64 <= partialBackend.programmed) )
+        {
+            std::cout << "ERROR: counter update read back wrong or programmed " << partialBackend.programmed << " bytes" << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: 4 byte update of a 200 byte file programmed " << partialBackend.programmed << " bytes" << std::endl;
+    }
+    {
+        EEPROMFS partialEeprom(&partialBackend);
+        uint32_t readBack = 0;
+
+        if ( (sizeof(readBack) != partialEeprom.readFileAt(6, 100, (uint8_t*)&readBack, sizeof(readBack))) ||
+             (0x01020304 != readBack) )
+        {
+            std::cout << "ERROR: counter update did not survive a remount" << std::endl;
+            std::cout << "INFO: EEPROM state: " << partialEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << std::endl;
+    std::cout << "--> Append Test - appends and ring files program only the new bytes <--" << std::endl;
+    EEPROMRamBackend appendRam(UNIX_FILE_SIZE);
+    CountingBackend appendBackend(appendRam);
+    {
+        EEPROMFS appendEeprom(&appendBackend);
+        uint8_t record[10];
+        uint8_t readBack[32];
+
+        appendEeprom.enableWrite();
+        appendEeprom.format();
+        appendEeprom.enableWrite();
+        appendEeprom.writeFile(2, (uint8_t*)"first,", 6);
+        appendEeprom.enableWrite();
+        if ( !appendEeprom.appendToFile(2, (uint8_t*)"second", 6) ||
+             (12 != appendEeprom.readFileAt(2, 0, readBack, sizeof(readBack))) ||
+             (0 != std::memcmp(readBack, "first,second", 12)) )
+        {
+            std::cout << "ERROR: appendToFile did not extend file 2" << std::endl;
+            std::cout << "INFO: EEPROM state: " << appendEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        // NUL terminated text: the append replaces the terminator instead of following it
+        appendEeprom.enableWrite();
+        appendEeprom.writeFile(1, (uint8_t*)"abc", 4);
+        appendEeprom.enableWrite();
+        if ( !appendEeprom.appendToFile(1, (uint8_t*)"def", 4) ||
+             (7 != appendEeprom.readFileAt(1, 0, readBack, sizeof(readBack))) ||
+             (0 != std::memcmp(readBack, "abcdef", 7)) )
+        {
+            std::cout << "ERROR: appendToFile did not continue the text of file 1" << std::endl;
+            std::cout << "INFO: EEPROM state: " << appendEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+
+        appendEeprom.enableWrite();
+        if ( !appendEeprom.createRingFile(7, 16) )
+        {
+            std::cout << "ERROR: createRingFile returned an error" << std::endl;
+            std::cout << "INFO: EEPROM state: " << appendEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        // two 10 byte records into a 16 byte ring: the oldest 4 bytes are overwritten
+        for ( uint8_t r = 0; r < 2; r++ )
+        {
+            std::memset(record, 'a' + r, sizeof(record));
+            appendBackend.programmed = 0;
+            appendEeprom.enableWrite();
+            if ( !appendEeprom.appendToFile(7, record, sizeof(record)) || (32 < appendBackend.programmed) )
+            {
+                std::cout << "ERROR: ring append failed or programmed " << appendBackend.programmed << " bytes" << std::endl;
+                return -1;
+            }
+        }
+        std::cout << "INFO: 10 byte ring append programmed " << appendBackend.programmed << " bytes" << std::endl;
+        appendEeprom.enableWrite();
+        if ( appendEeprom.writeFileAt(7, 0, record, 1) )
+        {
+            std::cout << "ERROR: writeFileAt accepted a ring file" << std::endl;
+            return -1;
+        }
+    }
+    {
+        EEPROMFS appendEeprom(&appendBackend);
+        uint8_t readBack[32];
+
+        if ( (16 != appendEeprom.readRingFile(7, readBack, sizeof(readBack))) ||
+             (0 != std::memcmp(readBack, "aaaaaabbbbbbbbbb", 16)) ||
+             (12 != appendEeprom.readFileAt(2, 0, readBack, sizeof(readBack))) ||
+             appendEeprom.isQuarantined(1) || (7 != appendEeprom.readFileAt(1, 0, readBack, sizeof(readBack))) )
+        {
+            std::cout << "ERROR: appended data did not survive a remount" << std::endl;
+            std::cout << "INFO: EEPROM state: " << appendEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << std::endl;
+    std::cout << "--> Named File Test - files are found by name through the directory <--" << std::endl;
+    EEPROMRamBackend namedRam(UNIX_FILE_SIZE);
+    {
+        EEPROMFS namedEeprom(&namedRam);
+        const char* wifi = "ssid=lab";
+        const char* log = "boot ok";
+
+        namedEeprom.enableWrite();
+        namedEeprom.format(EEPROM_DEFAULT_NUM_FILES, EEPROM_FS_FLAG_NAMES);
+        namedEeprom.enableWrite();
+        namedEeprom.writeNamedFile("wifi.cfg", (uint8_t*)wifi, strlen(wifi) + 1);
+        namedEeprom.enableWrite();
+        namedEeprom.writeNamedFile("boot.log", (uint8_t*)log, strlen(log) + 1);
+        if ( (namedEeprom.lookup("wifi.cfg") == namedEeprom.lookup("boot.log")) ||
+             (EEPROM_NO_FILE == namedEeprom.lookup("wifi.cfg")) ||
+             (EEPROM_NO_FILE != namedEeprom.lookup("missing.cfg")) )
+        {
+            std::cout << "ERROR: names were not bound to separate files" << std::endl;
+            std::cout << "INFO: EEPROM state: " << namedEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        // the directory's table entry belongs to the file system
+        namedEeprom.enableWrite();
+        if ( namedEeprom.writeFile(EEPROM_DEFAULT_NUM_FILES - 1, (uint8_t*)log, strlen(log) + 1) )
+        {
+            std::cout << "ERROR: writeFile was allowed to overwrite the directory" << std::endl;
+            return -1;
+        }
+        namedEeprom.enableWrite();
+        if ( !namedEeprom.deleteNamedFile("boot.log") || (EEPROM_NO_FILE != namedEeprom.lookup("boot.log")) )
+        {
+            std::cout << "ERROR: deleteNamedFile did not remove the name" << std::endl;
+            return -1;
+        }
+    }
+    {
+        EEPROMFS namedEeprom(&namedRam);
+        handle_t* hWifi = namedEeprom.open("wifi.cfg");
+
+        if ( (NULL == hWifi) || (NULL != namedEeprom.open("boot.log")) )
+        {
+            std::cout << "ERROR: directory did not survive a remount" << std::endl;
+            std::cout << "INFO: EEPROM state: " << namedEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        fileId_t wifiId = namedEeprom.lookup("wifi.cfg");
+
+        namedEeprom.getReadLock();
+        std::cout << "INFO: wifi.cfg is file " << wifiId << " and reads \"" << (const char*)hWifi->data << "\"" << std::endl;
+        namedEeprom.releaseReadLock();
+        namedEeprom.close(wifiId);
+    }
+
+#if defined(EEPROM_FS_STATS)
+    std::cout << std::endl;
+    std::cout << "--> Stats Test - counters track moves, programs, opens and the lock <--" << std::endl;
+    EEPROMRamBackend statsRam(UNIX_FILE_SIZE);
+    {
+        EEPROMFS statsEeprom(&statsRam);
+        const char* shortMsg = "short";
+        const char* longMsg = "a much longer message that pushes file 2 along";
+        eepromStats_t stats;
+        uint32_t waits = 0;
+        uint32_t holds = 0;
+
+        statsEeprom.enableWrite();
+        statsEeprom.format();
+        statsEeprom.enableWrite();
+        statsEeprom.writeFile(1, (uint8_t*)shortMsg, strlen(shortMsg) + 1);
+        statsEeprom.enableWrite();
+        statsEeprom.writeFile(2, (uint8_t*)shortMsg, strlen(shortMsg) + 1);
+        statsEeprom.resetStats();
+
+        // growing file 1 has to shift file 2 out of the way
+        statsEeprom.enableWrite();
+        statsEeprom.writeFile(1, (uint8_t*)longMsg, strlen(longMsg) + 1);
+        statsEeprom.open(1);
+        statsEeprom.open(1);
+        statsEeprom.close(1);
+        statsEeprom.close(1);
+
+        stats = statsEeprom.getStats();
+        for ( uint32_t i = 0; i < EEPROM_STATS_BUCKETS; i++ )
+        {
+            waits += stats.lockWait[i];
+            holds += stats.lockHold[i];
+        }
+        // resetStats() counted the release of the lock it zeroed the counters under, getStats()
+        //   still holds the lock while it takes the copy, so holds and acquisitions match
+        if ( (0 == stats.bytesMoved) || (1 != stats.tableCommits) || (0 == stats.bytesProgrammed) ||
+             (2 != stats.opens) || (1 != stats.handleFills) ||
+             (waits != stats.lockAcquisitions) || (holds != stats.lockAcquisitions) )
+        {
+            std::cout << "ERROR: stats do not add up" << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: growing a file moved " << stats.bytesMoved << " bytes and programmed " << stats.bytesProgrammed
+                  << " bytes in " << stats.programOperations << " operations" << std::endl;
+    }
+#endif
+
+#if defined(EEPROM_FS_WEAR)
+    std::cout << std::endl;
+    std::cout << "--> Wear Test - program counters find the hottest blocks and survive a remount <--" << std::endl;
+    EEPROMRamBackend wearRam(UNIX_FILE_SIZE);
+    uint32_t saved;
+    {
+        EEPROMFS wearEeprom(&wearRam);
+        const char* msgs[] = { "setting A", "setting B" };
+        wearBlock_t hottest[4];
+        uint32_t count;
+
+        wearEeprom.enableWrite();
+        wearEeprom.format();
+        for ( uint32_t i = 0; i < 50; i++ )
+        {
+            wearEeprom.enableWrite();
+            wearEeprom.writeFile(1, (uint8_t*)msgs[i & 1], strlen(msgs[i & 1]) + 1);
+        }
+
+        count = wearEeprom.getHottestBlocks(hottest, 4);
+        if ( (0 == count) || (50 > hottest[0].programs) ||
+             ((1 < count) && (hottest[0].programs < hottest[1].programs)) ||
+             (wearEeprom.getRemainingCycles(1000) != 1000 - hottest[0].programs) ||
+             (wearEeprom.forecastRemainingLife(60, 1000) != ((1000 - hottest[0].programs) * 60) / hottest[0].programs) )
+        {
+            std::cout << "ERROR: wear counters do not add up" << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: hottest block at " << hottest[0].address << " was programmed " << hottest[0].programs
+                  << " times, " << wearEeprom.getRemainingCycles() << " cycles left" << std::endl;
+
+        saved = hottest[0].programs;
+        wearEeprom.enableWrite();
+        if ( !wearEeprom.saveWearCounters(5) )
+        {
+            std::cout << "ERROR: saving the wear counters failed: " << wearEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+    }
+    {
+        EEPROMFS wearEeprom(&wearRam);
+        wearBlock_t hottest;
+
+        if ( !wearEeprom.loadWearCounters(5) || (1 != wearEeprom.getHottestBlocks(&hottest, 1)) ||
+             (saved > hottest.programs) )
+        {
+            std::cout << "ERROR: wear counters did not survive a remount" << std::endl;
+            return -1;
+        }
+        // a counter file from another block geometry is refused
+        if ( wearEeprom.loadWearCounters(1) )
+        {
+            std::cout << "ERROR: loaded wear counters from a file that does not hold any" << std::endl;
+            return -1;
+        }
+    }
+#endif
+
+    std::cout << std::endl;
+    std::cout << "--> Write-back Test - a burst of writes is programmed by a single sync() <--" << std::endl;
+    EEPROMRamBackend writeBackRam(UNIX_FILE_SIZE);
+    CountingBackend writeBackBackend(writeBackRam);
+    {
+        EEPROMFS writeBackEeprom(&writeBackBackend);
+        char msg[16];
+        handle_t* hMsg;
+        uint32_t programmed;
+
+        writeBackEeprom.enableWrite();
+        writeBackEeprom.format();
+        writeBackEeprom.setWriteBack(true, 60000, 1024);
+
+        programmed = writeBackBackend.programmed;
+        for ( uint32_t i = 0; i < 10; i++ )
+        {
+            snprintf(msg, sizeof(msg), "setting %u", (unsigned)i);
+            writeBackEeprom.enableWrite();
+            writeBackEeprom.writeFile(1, (uint8_t*)msg, strlen(msg) + 1);
+        }
+        if ( (programmed != writeBackBackend.programmed) || !writeBackEeprom.isSyncPending() )
+        {
+            std::cout << "ERROR: write-back mode programmed the EEPROM before sync()" << std::endl;
+            return -1;
+        }
+        // readers see the latest version, the EEPROM still holds the empty file system
+        hMsg = writeBackEeprom.open(1);
+        writeBackEeprom.getReadLock();
+        if ( (NULL == hMsg) || (0 != strcmp((const char*)hMsg->data, "setting 9")) )
+        {
+            std::cout << "ERROR: write-back mode hid an update from readers" << std::endl;
+            return -1;
+        }
+        writeBackEeprom.releaseReadLock();
+        writeBackEeprom.close(1);
+        {
+            EEPROMFS mounted(&writeBackBackend);
+            if ( 0 != mounted.getActiveFileCount() )
+            {
+                std::cout << "ERROR: an update reached the EEPROM before sync()" << std::endl;
+                return -1;
+            }
+        }
+
+        // idle delay not reached yet, then an explicit sync
+        if ( !writeBackEeprom.syncIfIdle() || !writeBackEeprom.isSyncPending() ||
+             !writeBackEeprom.sync() || writeBackEeprom.isSyncPending() )
+        {
+            std::cout << "ERROR: sync() failed: " << writeBackEeprom.getStatus().c_str() << std::endl;
+            return -1;
+        }
+        std::cout << "INFO: 10 writes programmed " << writeBackBackend.programmed - programmed << " bytes in one sync" << std::endl;
+        {
+            EEPROMFS mounted(&writeBackBackend);
+            char readBack[16];
+
+            if ( (0 == mounted.readFileAt(1, 0, (uint8_t*)readBack, sizeof(readBack))) ||
+                 (0 != strcmp(readBack, "setting 9")) )
+            {
+                std::cout << "ERROR: synced update did not survive a remount" << std::endl;
+                return -1;
+            }
+        }
+
+        // a write past the size threshold goes out right away
+        writeBackEeprom.setWriteBack(true, 60000, 16);
+        writeBackEeprom.enableWrite();
+        writeBackEeprom.writeFile(2, (uint8_t*)"long enough to pass the threshold", 34);
+        if ( writeBackEeprom.isSyncPending() )
+        {
+            std::cout << "ERROR: write-back mode held back an update past its size threshold" << std::endl;
+            return -1;
+        }
+    }
+
     return 0;
 }